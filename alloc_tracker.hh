@@ -0,0 +1,202 @@
+///////////////////////////////////////////////////////////////////////////////
+// alloc_tracker.hh
+//
+// Opt-in heap allocation tracking, for measuring how much solvers
+// allocate. Including this header replaces the global operator new
+// and operator delete with versions that count, per thread, the
+// allocations made, the bytes requested, and the live and peak live
+// bytes. Since it defines the replacement operators, it must be
+// included in exactly one translation unit of a program, and only in
+// programs that want tracking.
+//
+// How to use:
+//
+//    AllocationScope scope;
+//    // run the code you want measured
+//    AllocationStats stats = scope.stats();
+//    cout << stats.count << " allocations, " << stats.bytes << " bytes, "
+//         << stats.peak_live_bytes << " bytes peak" << endl;
+//
+// Counts include threads that the measured code started and joined,
+// such as the workers of the parallel solvers: each thread folds its
+// counters into shared totals when it exits. The peak of such a run
+// is the sum of each thread's own peak, an upper bound on the true
+// combined peak; for single-threaded code it is exact.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+struct AllocationStats {
+  uint64_t count;
+  uint64_t bytes;
+  int64_t peak_live_bytes;
+
+  AllocationStats() : count(0), bytes(0), peak_live_bytes(0) { }
+};
+
+namespace alloc_tracker {
+
+// Totals folded in from threads that have exited.
+struct Retired {
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> bytes;
+  std::atomic<int64_t> peak_live_bytes;
+};
+
+inline Retired& retired() {
+  // Zero-initialized before any dynamic initialization, so it is safe
+  // to use from allocations made during static initialization.
+  static Retired totals;
+  return totals;
+}
+
+// One thread's counters. Plain, trivially constructed fields so that
+// a thread's first allocation does not need to allocate.
+struct ThreadCounters {
+  uint64_t count;
+  uint64_t bytes;
+  int64_t live_bytes;
+  int64_t peak_live_bytes;
+};
+
+inline ThreadCounters& thread_counters();
+
+// Folds a thread's counters into retired() when the thread exits.
+struct ThreadRetirer {
+  ~ThreadRetirer() {
+    ThreadCounters& counters = thread_counters();
+    retired().count += counters.count;
+    retired().bytes += counters.bytes;
+    retired().peak_live_bytes += counters.peak_live_bytes;
+  }
+};
+
+inline ThreadCounters& thread_counters() {
+  static thread_local ThreadCounters counters;
+  return counters;
+}
+
+inline void register_thread() {
+  static thread_local ThreadRetirer retirer;
+  (void)retirer;
+}
+
+// Each block carries its size in a header of this many bytes, which
+// keeps the memory returned to the caller aligned for any type.
+const size_t header_bytes = 16;
+
+// Not inlined into the operators' callers, where the compiler would
+// see the header arithmetic and warn about out-of-bounds access.
+__attribute__((noinline)) inline void* allocate(size_t size) {
+  void* block = std::malloc(size + header_bytes);
+  if (!block) {
+    return nullptr;
+  }
+  *static_cast<size_t*>(block) = size;
+  register_thread();
+  ThreadCounters& counters = thread_counters();
+  counters.count++;
+  counters.bytes += size;
+  counters.live_bytes += size;
+  if (counters.live_bytes > counters.peak_live_bytes) {
+    counters.peak_live_bytes = counters.live_bytes;
+  }
+  return static_cast<char*>(block) + header_bytes;
+}
+
+__attribute__((noinline)) inline void deallocate(void* p) {
+  if (!p) {
+    return;
+  }
+  void* block = static_cast<char*>(p) - header_bytes;
+  thread_counters().live_bytes -= *static_cast<size_t*>(block);
+  std::free(block);
+}
+
+} // namespace alloc_tracker
+
+// Measures the allocations of the calling thread, and of threads that
+// exit, from construction until stats() is called.
+class AllocationScope {
+public:
+  AllocationScope() {
+    reset();
+  }
+
+  // Start measuring afresh.
+  void reset() {
+    alloc_tracker::register_thread();
+    alloc_tracker::ThreadCounters& counters = alloc_tracker::thread_counters();
+    counters.peak_live_bytes = counters.live_bytes;
+    _start_count = counters.count + alloc_tracker::retired().count;
+    _start_bytes = counters.bytes + alloc_tracker::retired().bytes;
+    _start_live_bytes = counters.live_bytes;
+    _start_retired_peak = alloc_tracker::retired().peak_live_bytes;
+  }
+
+  AllocationStats stats() const {
+    alloc_tracker::ThreadCounters& counters = alloc_tracker::thread_counters();
+    AllocationStats result;
+    result.count = counters.count + alloc_tracker::retired().count - _start_count;
+    result.bytes = counters.bytes + alloc_tracker::retired().bytes - _start_bytes;
+    result.peak_live_bytes = (counters.peak_live_bytes - _start_live_bytes)
+      + (alloc_tracker::retired().peak_live_bytes - _start_retired_peak);
+    return result;
+  }
+
+private:
+  uint64_t _start_count;
+  uint64_t _start_bytes;
+  int64_t _start_live_bytes;
+  int64_t _start_retired_peak;
+};
+
+void* operator new(size_t size) {
+  void* p = alloc_tracker::allocate(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return alloc_tracker::allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return alloc_tracker::allocate(size);
+}
+
+void operator delete(void* p) noexcept {
+  alloc_tracker::deallocate(p);
+}
+
+void operator delete[](void* p) noexcept {
+  alloc_tracker::deallocate(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  alloc_tracker::deallocate(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  alloc_tracker::deallocate(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  alloc_tracker::deallocate(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  alloc_tracker::deallocate(p);
+}
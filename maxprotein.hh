@@ -9,17 +9,40 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 #include <iterator>
 #include <cmath>
 
+#include <fcntl.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.hh"
+
 using namespace std;
 
 // One food item in the USDA database.
@@ -73,10 +96,311 @@ public:
 // Alias for a vector of shared pointers to Food objects.
 using FoodVector = std::vector<std::shared_ptr<Food>>;
 
+// The same foods as a FoodVector, stored as a structure of arrays:
+// kcal, protein and grams live in contiguous int32 columns that the
+// solvers scan directly, while the description and amount strings
+// sit in a side table that is only touched for printing. Foods are
+// referred to by their index in the table.
+class FoodTable {
+private:
+    std::vector<int32_t> _kcal;
+    std::vector<int32_t> _protein_g;
+    std::vector<int32_t> _amount_g;
+    std::vector<std::string> _description;
+    std::vector<std::string> _amount;
+    
+public:
+    // Create an empty table.
+    FoodTable() { }
+    
+    // Create a table holding the same foods as foods, in the same
+    // order.
+    explicit FoodTable(const FoodVector& foods) {
+        reserve(foods.size());
+        for (auto& food : foods) {
+            push_back(*food);
+        }
+    }
+    
+    void reserve(size_t n) {
+        _kcal.reserve(n);
+        _protein_g.reserve(n);
+        _amount_g.reserve(n);
+        _description.reserve(n);
+        _amount.reserve(n);
+    }
+    
+    void push_back(const std::string& description,
+                   const std::string& amount,
+                   int amount_g,
+                   int kcal,
+                   int protein_g) {
+        _description.push_back(description);
+        _amount.push_back(amount);
+        _amount_g.push_back(amount_g);
+        _kcal.push_back(kcal);
+        _protein_g.push_back(protein_g);
+    }
+    
+    void push_back(const Food& food) {
+        push_back(food.description(), food.amount(), food.amount_g(), food.kcal(), food.protein_g());
+    }
+    
+    size_t size() const { return _kcal.size(); }
+    bool empty() const { return _kcal.empty(); }
+    
+    int kcal(size_t i) const { return _kcal[i]; }
+    int protein_g(size_t i) const { return _protein_g[i]; }
+    int amount_g(size_t i) const { return _amount_g[i]; }
+    const std::string& description(size_t i) const { return _description[i]; }
+    const std::string& amount(size_t i) const { return _amount[i]; }
+    
+    // Raw column pointers for solver inner loops.
+    const int32_t* kcal_data() const { return _kcal.data(); }
+    const int32_t* protein_g_data() const { return _protein_g.data(); }
+    
+    // Build a new Food object for row i.
+    std::shared_ptr<Food> food(size_t i) const {
+        return std::shared_ptr<Food>(new Food(_description[i], _amount[i],
+                                              _amount_g[i], _kcal[i], _protein_g[i]));
+    }
+    
+    // Convert the rows named by indices, in that order, back into a
+    // FoodVector for the existing APIs.
+    std::unique_ptr<FoodVector> to_food_vector(const std::vector<int>& indices) const {
+        std::unique_ptr<FoodVector> result(new FoodVector);
+        result->reserve(indices.size());
+        for (int i : indices) {
+            result->push_back(food(i));
+        }
+        return result;
+    }
+    
+    // Convert the whole table back into a FoodVector.
+    std::unique_ptr<FoodVector> to_food_vector() const {
+        std::unique_ptr<FoodVector> result(new FoodVector);
+        result->reserve(size());
+        for (size_t i = 0; i < size(); i++) {
+            result->push_back(food(i));
+        }
+        return result;
+    }
+};
+
+// The result of a solver, as a reference to the chosen foods in the
+// solver's input rather than copies of them. When every chosen index
+// is below 64, which is always the case for exhaustive search, the
+// selection is a bitmask with bit i set when food i is chosen;
+// otherwise it is a sorted list of indices. Either way the total kcal
+// and protein are precomputed, so selections are cheap to keep,
+// compare and serialize, and are only turned into a FoodVector when
+// needed for printing.
+class Selection {
+private:
+    // True when the selection is stored in _mask, and _indices is
+    // empty.
+    bool _is_mask;
+    uint64_t _mask;
+    std::vector<int> _indices;
+    int _total_kcal;
+    int _total_protein_g;
+    
+public:
+    // Create an empty selection.
+    Selection()
+    : _is_mask(true), _mask(0), _total_kcal(0), _total_protein_g(0) { }
+    
+    // Create a selection of the foods with the given indices, in any
+    // order and without duplicates, whose totals are total_kcal and
+    // total_protein_g.
+    Selection(std::vector<int> indices, int total_kcal, int total_protein_g)
+    : _is_mask(true), _mask(0), _total_kcal(total_kcal), _total_protein_g(total_protein_g) {
+        std::sort(indices.begin(), indices.end());
+        if (!indices.empty() && indices.back() >= 64) {
+            _is_mask = false;
+            _indices = std::move(indices);
+        } else {
+            for (int i : indices) {
+                _mask |= uint64_t(1) << i;
+            }
+        }
+    }
+    
+    // Create a selection of the foods whose bits are set in mask.
+    static Selection from_mask(uint64_t mask, int total_kcal, int total_protein_g) {
+        Selection result;
+        result._mask = mask;
+        result._total_kcal = total_kcal;
+        result._total_protein_g = total_protein_g;
+        return result;
+    }
+    
+    int total_kcal() const { return _total_kcal; }
+    int total_protein_g() const { return _total_protein_g; }
+    
+    // True when the selection is held as a bitmask, so mask() is
+    // valid.
+    bool has_mask() const { return _is_mask; }
+    uint64_t mask() const { assert(_is_mask); return _mask; }
+    
+    size_t size() const {
+        return _is_mask ? __builtin_popcountll(_mask) : _indices.size();
+    }
+    bool empty() const { return size() == 0; }
+    
+    // True when food i is chosen.
+    bool contains(int i) const {
+        if (_is_mask) {
+            return (i >= 0) && (i < 64) && ((_mask >> i) & 1);
+        }
+        return std::binary_search(_indices.begin(), _indices.end(), i);
+    }
+    
+    // The chosen indices, in increasing order.
+    std::vector<int> indices() const {
+        if (!_is_mask) {
+            return _indices;
+        }
+        std::vector<int> result;
+        for (uint64_t bits = _mask; bits; bits &= bits - 1) {
+            result.push_back(__builtin_ctzll(bits));
+        }
+        return result;
+    }
+    
+    // The chosen foods of foods, the input the selection was computed
+    // from, in index order. The Food objects are shared, not copied.
+    std::unique_ptr<FoodVector> to_food_vector(const FoodVector& foods) const {
+        std::unique_ptr<FoodVector> result(new FoodVector);
+        for (int i : indices()) {
+            result->push_back(foods[i]);
+        }
+        return result;
+    }
+    
+    // The chosen rows of table, in index order.
+    std::unique_ptr<FoodVector> to_food_vector(const FoodTable& table) const {
+        return table.to_food_vector(indices());
+    }
+    
+    bool operator==(const Selection& other) const {
+        return (_total_kcal == other._total_kcal) &&
+        (_total_protein_g == other._total_protein_g) &&
+        (indices() == other.indices());
+    }
+    bool operator!=(const Selection& other) const { return !(*this == other); }
+    
+    // Compact text form: "kcal protein_g i1,i2,...".
+    std::string serialize() const {
+        std::stringstream ss;
+        ss << _total_kcal << ' ' << _total_protein_g << ' ';
+        std::vector<int> chosen = indices();
+        for (size_t i = 0; i < chosen.size(); i++) {
+            ss << (i ? "," : "") << chosen[i];
+        }
+        return ss.str();
+    }
+    
+    // Parse the output of serialize(). Returns false when text is
+    // malformed or holds an index outside [0, input_size), the number
+    // of foods the selection is over, leaving output unchanged.
+    static bool deserialize(const std::string& text, Selection& output,
+                            size_t input_size = size_t(std::numeric_limits<int>::max()) + 1) {
+        std::stringstream ss(text);
+        int total_kcal, total_protein_g;
+        if (!(ss >> total_kcal >> total_protein_g)) {
+            return false;
+        }
+        std::vector<int> chosen;
+        std::string list;
+        if (ss >> list) {
+            std::stringstream items(list);
+            for (std::string item; std::getline(items, item, ','); ) {
+                char* end;
+                errno = 0;
+                long i = std::strtol(item.c_str(), &end, 10);
+                // Range-check the long, before narrowing it to int.
+                if (item.empty() || *end != '\0' || errno == ERANGE ||
+                    i < 0 || static_cast<unsigned long>(i) >= input_size ||
+                    i > std::numeric_limits<int>::max()) {
+                    return false;
+                }
+                chosen.push_back(int(i));
+            }
+        }
+        output = Selection(chosen, total_kcal, total_protein_g);
+        return true;
+    }
+};
+
+// Parse a decimal number in the string field and round it to the
+// nearest int, by reading a double through a stringstream. This is
+// the reference behavior for parse_mil_range, which only falls back
+// to it for unusual inputs. Returns false when the field does not
+// start with a number.
+bool parse_mil_stream(int& output, const std::string& field) {
+    std::stringstream ss(field);
+    double floating;
+    ss >> floating;
+    if ( ! ss ) {
+        return false;
+    } else {
+        output = lround(floating);
+        return true;
+    }
+}
+
+// Parse a decimal number in the character range [begin, end) and
+// round it to the nearest int, with exactly the same result as
+// parse_mil_stream but without allocating or touching a locale.
+//
+// Plain fixed-point numbers ([+-]digits[.digits], the only form that
+// appears in ABBREV.txt) are parsed directly as an integer mantissa
+// and rounded half away from zero, which is what lround does. With at
+// most 15 significant digits, the nearest double can never land on
+// the other side of a .5 boundary, so the results agree bit for bit.
+// Anything else falls back to parse_mil_stream.
+bool parse_mil_range(int& output, const char* begin, const char* end) {
+    
+    const char* p = begin;
+    bool negative = false;
+    if (p != end && (*p == '+' || *p == '-')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    
+    int64_t integer = 0, fraction = 0, fraction_scale = 1;
+    int digits = 0;
+    const char* integer_begin = p;
+    for (; p != end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+        integer = integer * 10 + (*p - '0');
+    }
+    bool has_integer = (p != integer_begin);
+    bool has_fraction = false;
+    if (p != end && *p == '.') {
+        ++p;
+        const char* fraction_begin = p;
+        for (; p != end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+            fraction = fraction * 10 + (*p - '0');
+            fraction_scale *= 10;
+        }
+        has_fraction = (p != fraction_begin);
+    }
+    
+    if (p != end || !(has_integer || has_fraction) || digits > 15) {
+        return parse_mil_stream(output, std::string(begin, end));
+    }
+    
+    int64_t rounded = integer + ((2 * fraction >= fraction_scale) ? 1 : 0);
+    output = negative ? -rounded : rounded;
+    return true;
+}
+
 // Load all the valid foods from a USDA database in their ABBREV
 // format. Foods that are missing fields such as the amount string are
 // skipped. Returns nullptr on I/O error.
 std::unique_ptr<FoodVector> load_usda_abbrev(const std::string& path) {
+    TRACE_SPAN("load_usda_abbrev");
     
     std::unique_ptr<FoodVector> failure(nullptr);
     
@@ -118,15 +442,7 @@ std::unique_ptr<FoodVector> load_usda_abbrev(const std::string& path) {
         };
         
         auto parse_mil = [](int& output, const std::string& field) {
-            std::stringstream ss(field);
-            double floating;
-            ss >> floating;
-            if ( ! ss ) {
-                return false;
-            } else {
-                output = lround(floating);
-                return true;
-            }
+            return parse_mil_range(output, field.data(), field.data() + field.size());
         };
         
         std::string description, amount;
@@ -149,6 +465,709 @@ std::unique_ptr<FoodVector> load_usda_abbrev(const std::string& path) {
     return result;
 }
 
+// A read-only memory mapping of an entire file, released when the
+// object goes out of scope. An empty file maps to an empty range.
+class MappedFile {
+public:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    // Map the file at path. Check ok() before using the contents.
+    explicit MappedFile(const std::string& path)
+    : _data(nullptr), _size(0), _ok(false) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0) {
+            _size = st.st_size;
+            if (_size == 0) {
+                _ok = true;
+            } else {
+                void* p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    _data = static_cast<const char*>(p);
+                    _ok = true;
+                }
+            }
+        }
+        ::close(fd);
+    }
+    
+    ~MappedFile() {
+        if (_data) {
+            ::munmap(const_cast<char*>(_data), _size);
+        }
+    }
+    
+    bool ok() const { return _ok; }
+    const char* begin() const { return _data; }
+    const char* end() const { return _data + _size; }
+    size_t size() const { return _size; }
+    
+private:
+    const char* _data;
+    size_t _size;
+    bool _ok;
+};
+
+// Column numbers of the ABBREV fields that we actually use.
+const int ABBREV_FIELD_COUNT = 53,
+ABBREV_DESCR = 1,
+ABBREV_KCAL = 3,
+ABBREV_PROTEIN_G = 4,
+ABBREV_AMOUNT_G = 48,
+ABBREV_AMOUNT = 49;
+
+// Strip the ~ quote markers from the character range [begin, end),
+// in place. Returns false when the field is not a non-empty quoted
+// string.
+bool remove_tildes_range(const char*& begin, const char*& end) {
+    if ((end - begin < 3) || (*begin != '~') || (*(end - 1) != '~')) {
+        return false;
+    }
+    ++begin;
+    --end;
+    return true;
+}
+
+// Instruction sets that the vectorized code paths can be dispatched
+// to at runtime.
+enum class SimdIsa { scalar, sse2, avx2, avx512 };
+
+// Human-readable name of a SimdIsa, for benchmark output.
+const char* simd_isa_name(SimdIsa isa) {
+    switch (isa) {
+        case SimdIsa::sse2: return "sse2";
+        case SimdIsa::avx2: return "avx2";
+        case SimdIsa::avx512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+// True when the running CPU supports isa.
+bool simd_isa_supported(SimdIsa isa) {
+#if defined(__x86_64__) || defined(__i386__)
+    switch (isa) {
+        case SimdIsa::sse2: return __builtin_cpu_supports("sse2");
+        case SimdIsa::avx2: return __builtin_cpu_supports("avx2");
+        case SimdIsa::avx512: return __builtin_cpu_supports("avx512f");
+        default: return true;
+    }
+#else
+    return isa == SimdIsa::scalar;
+#endif
+}
+
+// The fastest line indexer the running CPU supports, detected once.
+// There is no AVX-512 indexer; ABBREV lines are too short to gain
+// from wider vectors.
+SimdIsa best_tokenizer_isa() {
+    static const SimdIsa best =
+    simd_isa_supported(SimdIsa::avx2) ? SimdIsa::avx2 :
+    simd_isa_supported(SimdIsa::sse2) ? SimdIsa::sse2 :
+    SimdIsa::scalar;
+    return best;
+}
+
+// A line indexer records the position of every ^ separator from p up
+// to the end of the line, into seps, and returns a pointer to the
+// line's \n, or to end when the last line has no newline. Only the
+// first ABBREV_FIELD_COUNT separators are stored, but all of them
+// are counted in count, which the caller initializes to 0.
+
+// Scalar indexer, also used for the tail of a line that is shorter
+// than one vector.
+const char* index_abbrev_line_scalar(const char* p, const char* end,
+                                     const char** seps, int& count) {
+    for (; p != end; ++p) {
+        if (*p == '^') {
+            if (count < ABBREV_FIELD_COUNT) {
+                seps[count] = p;
+            }
+            ++count;
+        } else if (*p == '\n') {
+            break;
+        }
+    }
+    return p;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Record the separators flagged in bitmask carets, which covers the
+// bytes starting at block.
+inline void record_abbrev_seps(const char* block, uint32_t carets,
+                               const char** seps, int& count) {
+    for (; carets; carets &= carets - 1) {
+        if (count < ABBREV_FIELD_COUNT) {
+            seps[count] = block + __builtin_ctz(carets);
+        }
+        ++count;
+    }
+}
+
+// SSE2 indexer: compares 16 bytes at a time against ^ and \n.
+__attribute__((target("sse2")))
+const char* index_abbrev_line_sse2(const char* p, const char* end,
+                                   const char** seps, int& count) {
+    const __m128i caret = _mm_set1_epi8('^'), newline = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t carets = _mm_movemask_epi8(_mm_cmpeq_epi8(block, caret)),
+        newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        if (newlines) {
+            // Keep only the separators before the first newline.
+            carets &= (newlines & (0u - newlines)) - 1;
+            record_abbrev_seps(p, carets, seps, count);
+            return p + __builtin_ctz(newlines);
+        }
+        record_abbrev_seps(p, carets, seps, count);
+    }
+    return index_abbrev_line_scalar(p, end, seps, count);
+}
+
+// AVX2 indexer: compares 32 bytes at a time against ^ and \n.
+__attribute__((target("avx2")))
+const char* index_abbrev_line_avx2(const char* p, const char* end,
+                                   const char** seps, int& count) {
+    const __m256i caret = _mm256_set1_epi8('^'), newline = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t carets = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, caret)),
+        newlines = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+        if (newlines) {
+            carets &= (newlines & (0u - newlines)) - 1;
+            record_abbrev_seps(p, carets, seps, count);
+            return p + __builtin_ctz(newlines);
+        }
+        record_abbrev_seps(p, carets, seps, count);
+    }
+    return index_abbrev_line_scalar(p, end, seps, count);
+}
+
+#endif
+
+// Index the line starting at p with the given instruction set. isa
+// must be supported by the running CPU.
+inline const char* index_abbrev_line(SimdIsa isa, const char* p, const char* end,
+                                     const char** seps, int& count) {
+#if defined(__x86_64__) || defined(__i386__)
+    switch (isa) {
+        case SimdIsa::avx512:
+        case SimdIsa::avx2: return index_abbrev_line_avx2(p, end, seps, count);
+        case SimdIsa::sse2: return index_abbrev_line_sse2(p, end, seps, count);
+        default: break;
+    }
+#endif
+    return index_abbrev_line_scalar(p, end, seps, count);
+}
+
+// Parse the one ABBREV record in [begin, end), which excludes the
+// trailing newline, given the positions of its ^ separators from the
+// line indexer. Only the columns we use are looked at, and no
+// temporary strings are created. food is set to the parsed food, or
+// to nullptr when the record is skipped for missing fields. Returns
+// false when the line does not have exactly 53 fields, which makes
+// the whole file invalid, just as in load_usda_abbrev.
+bool parse_abbrev_record(const char* begin, const char* end,
+                         const char* const* seps, int sep_count,
+                         std::shared_ptr<Food>& food) {
+    
+    food.reset();
+    
+    // Mirror std::getline(ss, field, '^'): an empty line has no
+    // fields, and a trailing ^ does not start another field.
+    int field_count = sep_count + 1;
+    if (begin == end) {
+        field_count = 0;
+    } else if (sep_count > 0 && sep_count <= ABBREV_FIELD_COUNT && seps[sep_count - 1] == end - 1) {
+        field_count = sep_count;
+    }
+    if (field_count != ABBREV_FIELD_COUNT) {
+        return false;
+    }
+    
+    // Field i runs from just past separator i-1 to separator i.
+    auto field_begin = [&](int i) { return (i == 0) ? begin : seps[i - 1] + 1; };
+    auto field_end = [&](int i) { return (i < sep_count) ? seps[i] : end; };
+    
+    const char *descr_begin = field_begin(ABBREV_DESCR),
+    *descr_end = field_end(ABBREV_DESCR),
+    *amount_begin = field_begin(ABBREV_AMOUNT),
+    *amount_end = field_end(ABBREV_AMOUNT);
+    int amount_g, kcal, protein_g;
+    if ( remove_tildes_range(descr_begin, descr_end) &&
+        remove_tildes_range(amount_begin, amount_end) &&
+        parse_mil_range(amount_g, field_begin(ABBREV_AMOUNT_G), field_end(ABBREV_AMOUNT_G)) &&
+        parse_mil_range(kcal, field_begin(ABBREV_KCAL), field_end(ABBREV_KCAL)) &&
+        parse_mil_range(protein_g, field_begin(ABBREV_PROTEIN_G), field_end(ABBREV_PROTEIN_G)) ) {
+        food.reset(new Food(std::string(descr_begin, descr_end),
+                            std::string(amount_begin, amount_end),
+                            amount_g,
+                            kcal,
+                            protein_g));
+    }
+    return true;
+}
+
+// Scan the ABBREV records in the buffer [begin, end) in order, using
+// the line indexer for isa, and call visit(food) with each valid
+// food until visit returns false. Returns false if a malformed line
+// is reached before then.
+template <typename Visitor>
+bool scan_abbrev_buffer(const char* begin, const char* end, SimdIsa isa, Visitor visit) {
+    const char* seps[ABBREV_FIELD_COUNT];
+    std::shared_ptr<Food> food;
+    const char* p = begin;
+    while (p != end) {
+        int sep_count = 0;
+        const char* line_end = index_abbrev_line(isa, p, end, seps, sep_count);
+        if (!parse_abbrev_record(p, line_end, seps, sep_count, food)) {
+            return false;
+        }
+        if (food && !visit(food)) {
+            return true;
+        }
+        p = (line_end == end) ? end : line_end + 1;
+    }
+    return true;
+}
+
+// Parse every ABBREV record in the buffer [begin, end), appending
+// valid foods to result, using the vectorized line indexer for
+// isa. Returns false if any line is malformed.
+bool parse_abbrev_buffer(const char* begin, const char* end, FoodVector& result,
+                         SimdIsa isa = best_tokenizer_isa()) {
+    return scan_abbrev_buffer(begin, end, isa, [&](const std::shared_ptr<Food>& food) {
+        result.push_back(food);
+        return true;
+    });
+}
+
+// Same as load_usda_abbrev, but maps the file into memory and scans
+// the buffer in place instead of going through iostreams. Produces
+// exactly the same foods. isa selects the line indexer, and must be
+// supported by the running CPU. Returns nullptr on I/O error.
+std::unique_ptr<FoodVector> load_usda_abbrev_mmap(const std::string& path,
+                                                  SimdIsa isa = best_tokenizer_isa()) {
+    TRACE_SPAN("load_usda_abbrev_mmap");
+    
+    MappedFile file(path);
+    if (!file.ok()) {
+        return std::unique_ptr<FoodVector>(nullptr);
+    }
+    
+    std::unique_ptr<FoodVector> result(new FoodVector);
+    if (!parse_abbrev_buffer(file.begin(), file.end(), *result, isa)) {
+        return std::unique_ptr<FoodVector>(nullptr);
+    }
+    return result;
+}
+
+// Same as load_usda_abbrev_mmap, but splits the file into chunks at
+// line boundaries and parses the chunks on a pool of thread_count
+// worker threads. Chunk results are joined in file order, so the
+// foods come out in exactly the same order as the serial
+// loaders. When thread_count is 0, one thread per hardware core is
+// used. Returns nullptr on I/O error.
+std::unique_ptr<FoodVector> load_usda_abbrev_parallel(const std::string& path,
+                                                      unsigned thread_count = 0) {
+    TRACE_SPAN("load_usda_abbrev_parallel");
+    
+    std::unique_ptr<FoodVector> failure(nullptr);
+    
+    MappedFile file(path);
+    if (!file.ok()) {
+        return failure;
+    }
+    
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    // Several chunks per thread so that a slow chunk does not hold
+    // up the others, but no chunk smaller than 64 KiB.
+    const size_t min_chunk_bytes = 64 * 1024;
+    size_t chunk_count = std::max<size_t>(1, std::min<size_t>(thread_count * 4,
+                                                              file.size() / min_chunk_bytes));
+    
+    // Chunk boundaries, each moved forward to just past a newline.
+    std::vector<const char*> bounds;
+    bounds.push_back(file.begin());
+    for (size_t i = 1; i < chunk_count; i++) {
+        const char* p = std::max(bounds.back(), file.begin() + file.size() * i / chunk_count);
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', file.end() - p));
+        if (!newline) {
+            break;
+        }
+        if (newline + 1 != bounds.back()) {
+            bounds.push_back(newline + 1);
+        }
+    }
+    bounds.push_back(file.end());
+    chunk_count = bounds.size() - 1;
+    
+    std::vector<FoodVector> chunks(chunk_count);
+    std::vector<char> chunk_ok(chunk_count, 1);
+    std::atomic<size_t> next_chunk(0);
+    
+    auto worker = [&]() {
+        for (size_t i = next_chunk++; i < chunk_count; i = next_chunk++) {
+            TRACE_SPAN("parse_chunk");
+            chunk_ok[i] = parse_abbrev_buffer(bounds[i], bounds[i + 1], chunks[i]);
+        }
+    };
+    
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < std::min<size_t>(thread_count, chunk_count); t++) {
+        pool.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    
+    size_t total = 0;
+    for (size_t i = 0; i < chunk_count; i++) {
+        if (!chunk_ok[i]) {
+            return failure;
+        }
+        total += chunks[i].size();
+    }
+    
+    std::unique_ptr<FoodVector> result(new FoodVector);
+    result->reserve(total);
+    for (auto& chunk : chunks) {
+        result->insert(result->end(), chunk.begin(), chunk.end());
+    }
+    return result;
+}
+
+// Binary snapshot of a FoodVector, so that later runs can skip
+// parsing ABBREV.txt. The file is laid out as a fixed header followed
+// by columnar arrays:
+//
+//    FoodSnapshotHeader
+//    int32_t  kcal[count]
+//    int32_t  protein_g[count]
+//    int32_t  amount_g[count]
+//    uint32_t string_offsets[2 * count + 1]
+//    char     strings[string_bytes]
+//
+// Food i's description is strings[offsets[2i] .. offsets[2i+1]) and
+// its amount is strings[offsets[2i+1] .. offsets[2i+2]). The header
+// records the size and mtime of the source file the snapshot was
+// built from, so a stale snapshot can be detected, plus a checksum of
+// everything after the header to detect corruption.
+struct FoodSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t string_bytes;
+    uint64_t checksum;
+};
+
+const char FOOD_SNAPSHOT_MAGIC[8] = { 'M', 'P', 'F', 'O', 'O', 'D', 'S', 'N' };
+const uint32_t FOOD_SNAPSHOT_VERSION = 1;
+
+// Hash of the byte range [begin, end), used as the snapshot checksum.
+// Consumes eight bytes at a time, so it adds little to load time.
+uint64_t snapshot_checksum(const char* begin, const char* end) {
+    uint64_t hash = 14695981039346656037ULL;
+    const uint64_t prime = 1099511628211ULL;
+    for (; end - begin >= 8; begin += 8) {
+        uint64_t word;
+        std::memcpy(&word, begin, 8);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; begin != end; ++begin) {
+        hash = (hash ^ static_cast<unsigned char>(*begin)) * prime;
+    }
+    return hash;
+}
+
+// Look up the size and modification time of the file at path. Returns
+// false when it cannot be stat'ed.
+bool source_file_stamp(const std::string& path,
+                       uint64_t& size,
+                       int64_t& mtime_sec,
+                       int64_t& mtime_nsec) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    size = st.st_size;
+    mtime_sec = st.st_mtim.tv_sec;
+    mtime_nsec = st.st_mtim.tv_nsec;
+    return true;
+}
+
+// Write foods to a snapshot file at snapshot_path, stamped with the
+// given size and mtime of the source file, which the caller should
+// take before parsing it, so that a source modified during the parse
+// leaves a stale snapshot rather than one that looks current. The
+// snapshot is written to a uniquely named temporary file in the same
+// directory and renamed into place, so readers never observe a
+// half-written snapshot and concurrent writers do not collide. The
+// temporary file is removed on error. Returns false on I/O error.
+bool write_food_snapshot(const std::string& snapshot_path,
+                         const FoodVector& foods,
+                         uint64_t source_size,
+                         int64_t source_mtime_sec,
+                         int64_t source_mtime_nsec) {
+    
+    FoodSnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, FOOD_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = FOOD_SNAPSHOT_VERSION;
+    header.count = foods.size();
+    header.source_size = source_size;
+    header.source_mtime_sec = source_mtime_sec;
+    header.source_mtime_nsec = source_mtime_nsec;
+    
+    std::vector<int32_t> kcal, protein_g, amount_g;
+    std::vector<uint32_t> offsets;
+    std::string strings;
+    offsets.push_back(0);
+    for (auto& food : foods) {
+        kcal.push_back(food->kcal());
+        protein_g.push_back(food->protein_g());
+        amount_g.push_back(food->amount_g());
+        strings += food->description();
+        offsets.push_back(strings.size());
+        strings += food->amount();
+        offsets.push_back(strings.size());
+    }
+    header.string_bytes = strings.size();
+    
+    std::string payload;
+    payload.append(reinterpret_cast<const char*>(kcal.data()), kcal.size() * sizeof(int32_t));
+    payload.append(reinterpret_cast<const char*>(protein_g.data()), protein_g.size() * sizeof(int32_t));
+    payload.append(reinterpret_cast<const char*>(amount_g.data()), amount_g.size() * sizeof(int32_t));
+    payload.append(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    payload += strings;
+    header.checksum = snapshot_checksum(payload.data(), payload.data() + payload.size());
+    
+    std::vector<char> temp_path(snapshot_path.begin(), snapshot_path.end());
+    const char suffix[] = ".XXXXXX";
+    temp_path.insert(temp_path.end(), suffix, suffix + sizeof(suffix));
+    int fd = ::mkstemp(temp_path.data());
+    if (fd < 0) {
+        return false;
+    }
+    // mkstemp creates the file private to its owner; a snapshot is as
+    // readable as an ordinary file.
+    ::fchmod(fd, 0644);
+    bool ok = true;
+    for (const std::string& part : { std::string(reinterpret_cast<const char*>(&header), sizeof(header)),
+                                     payload }) {
+        for (size_t done = 0; ok && done < part.size(); ) {
+            ssize_t written = ::write(fd, part.data() + done, part.size() - done);
+            if (written <= 0) {
+                ok = false;
+            } else {
+                done += written;
+            }
+        }
+    }
+    ok = (::close(fd) == 0) && ok;
+    ok = ok && (std::rename(temp_path.data(), snapshot_path.c_str()) == 0);
+    if (!ok) {
+        ::unlink(temp_path.data());
+    }
+    return ok;
+}
+
+// Write foods to a snapshot file at snapshot_path, stamped with the
+// current size and mtime of source_path. Returns false on I/O error.
+bool write_food_snapshot(const std::string& snapshot_path,
+                         const FoodVector& foods,
+                         const std::string& source_path) {
+    uint64_t size;
+    int64_t mtime_sec, mtime_nsec;
+    return source_file_stamp(source_path, size, mtime_sec, mtime_nsec) &&
+    write_food_snapshot(snapshot_path, foods, size, mtime_sec, mtime_nsec);
+}
+
+// A food snapshot mapped read-only into memory. The columns are read
+// straight out of the mapping, so opening a snapshot costs one mmap
+// plus a checksum pass and a bounds check of the string offsets,
+// independent of how the foods are later used.
+class FoodSnapshot {
+public:
+    // Map the snapshot at snapshot_path and validate it against the
+    // current size and mtime of source_path. Check ok() before using
+    // the contents; ok() is false when the snapshot is missing, stale,
+    // truncated, or corrupt. Every string offset is checked to lie
+    // within the string table, so description() and amount() never
+    // read outside the mapping, even when the checksum happens to
+    // match a damaged file.
+    FoodSnapshot(const std::string& snapshot_path, const std::string& source_path)
+    : _file(snapshot_path), _ok(false), _header(nullptr), _kcal(nullptr),
+    _protein_g(nullptr), _amount_g(nullptr), _offsets(nullptr), _strings(nullptr) {
+        
+        if (!_file.ok() || _file.size() < sizeof(FoodSnapshotHeader)) {
+            return;
+        }
+        _header = reinterpret_cast<const FoodSnapshotHeader*>(_file.begin());
+        if ((std::memcmp(_header->magic, FOOD_SNAPSHOT_MAGIC, sizeof(_header->magic)) != 0) ||
+            (_header->version != FOOD_SNAPSHOT_VERSION)) {
+            return;
+        }
+        
+        uint64_t source_size;
+        int64_t mtime_sec, mtime_nsec;
+        if (!source_file_stamp(source_path, source_size, mtime_sec, mtime_nsec) ||
+            (source_size != _header->source_size) ||
+            (mtime_sec != _header->source_mtime_sec) ||
+            (mtime_nsec != _header->source_mtime_nsec)) {
+            return;
+        }
+        
+        uint64_t n = _header->count;
+        uint64_t expected_size = sizeof(FoodSnapshotHeader) +
+        3 * n * sizeof(int32_t) +
+        (2 * n + 1) * sizeof(uint32_t) +
+        _header->string_bytes;
+        if (_file.size() != expected_size) {
+            return;
+        }
+        
+        const char* payload = _file.begin() + sizeof(FoodSnapshotHeader);
+        if (snapshot_checksum(payload, _file.end()) != _header->checksum) {
+            return;
+        }
+        
+        _kcal = reinterpret_cast<const int32_t*>(payload);
+        _protein_g = _kcal + n;
+        _amount_g = _protein_g + n;
+        _offsets = reinterpret_cast<const uint32_t*>(_amount_g + n);
+        _strings = reinterpret_cast<const char*>(_offsets + 2 * n + 1);
+        
+        for (uint64_t i = 0; i < 2 * n; i++) {
+            if ((_offsets[i] > _offsets[i + 1]) ||
+                (_offsets[i + 1] > _header->string_bytes)) {
+                return;
+            }
+        }
+        _ok = true;
+    }
+    
+    bool ok() const { return _ok; }
+    size_t size() const { return _ok ? _header->count : 0; }
+    
+    int kcal(size_t i) const { return _kcal[i]; }
+    int protein_g(size_t i) const { return _protein_g[i]; }
+    int amount_g(size_t i) const { return _amount_g[i]; }
+    
+    // The columns, straight out of the mapping, for the column solvers
+    // such as exhaustive_selection.
+    const int32_t* kcal_data() const { return _kcal; }
+    const int32_t* protein_g_data() const { return _protein_g; }
+    const int32_t* amount_g_data() const { return _amount_g; }
+    
+    std::string description(size_t i) const {
+        return std::string(_strings + _offsets[2 * i], _strings + _offsets[2 * i + 1]);
+    }
+    std::string amount(size_t i) const {
+        return std::string(_strings + _offsets[2 * i + 1], _strings + _offsets[2 * i + 2]);
+    }
+    
+    // Copy the snapshot columns into a FoodTable.
+    FoodTable to_food_table() const {
+        FoodTable table;
+        table.reserve(size());
+        for (size_t i = 0; i < size(); i++) {
+            table.push_back(description(i), amount(i), amount_g(i), kcal(i), protein_g(i));
+        }
+        return table;
+    }
+    
+    // Materialize the snapshot as a FoodVector for the existing APIs.
+    std::unique_ptr<FoodVector> to_food_vector() const {
+        std::unique_ptr<FoodVector> result(new FoodVector);
+        result->reserve(size());
+        for (size_t i = 0; i < size(); i++) {
+            result->push_back(std::shared_ptr<Food>(new Food(description(i),
+                                                             amount(i),
+                                                             amount_g(i),
+                                                             kcal(i),
+                                                             protein_g(i))));
+        }
+        return result;
+    }
+    
+private:
+    MappedFile _file;
+    bool _ok;
+    const FoodSnapshotHeader* _header;
+    const int32_t* _kcal;
+    const int32_t* _protein_g;
+    const int32_t* _amount_g;
+    const uint32_t* _offsets;
+    const char* _strings;
+};
+
+// Parse the ABBREV file at path and write its snapshot to
+// snapshot_path, stamped with the source as it was before parsing.
+// Returns the parsed foods, or nullptr on I/O error reading path;
+// failing to write the snapshot is not an error.
+std::unique_ptr<FoodVector> rebuild_food_snapshot(const std::string& path,
+                                                  const std::string& snapshot_path) {
+    uint64_t size;
+    int64_t mtime_sec, mtime_nsec;
+    bool stamped = source_file_stamp(path, size, mtime_sec, mtime_nsec);
+    auto foods = load_usda_abbrev_mmap(path);
+    if (foods && stamped) {
+        write_food_snapshot(snapshot_path, *foods, size, mtime_sec, mtime_nsec);
+    }
+    return foods;
+}
+
+// Open the snapshot at snapshot_path of the ABBREV file at path,
+// first (re)building it when it is missing, stale or corrupt. On a
+// valid snapshot the columns and strings are used in place, without
+// creating any Food objects. Returns nullptr when path cannot be read
+// or the snapshot cannot be written.
+std::unique_ptr<FoodSnapshot> load_usda_abbrev_snapshot(const std::string& path,
+                                                        const std::string& snapshot_path) {
+    TRACE_SPAN("load_usda_abbrev_snapshot");
+    std::unique_ptr<FoodSnapshot> snapshot(new FoodSnapshot(snapshot_path, path));
+    if (snapshot->ok()) {
+        return snapshot;
+    }
+    if (!rebuild_food_snapshot(path, snapshot_path)) {
+        return nullptr;
+    }
+    snapshot.reset(new FoodSnapshot(snapshot_path, path));
+    return snapshot->ok() ? std::move(snapshot) : nullptr;
+}
+
+// Load the foods of the ABBREV file at path, using the snapshot at
+// snapshot_path when it is valid for that file. Otherwise the text
+// file is parsed and the snapshot is (re)built for next time; failing
+// to write the snapshot is not an error. Returns nullptr on I/O error
+// reading path. A FoodVector holds one Food object per row, so even a
+// snapshot hit creates all of them; callers that can work on columns
+// should use load_usda_abbrev_snapshot instead.
+std::unique_ptr<FoodVector> load_usda_abbrev_cached(const std::string& path,
+                                                    const std::string& snapshot_path) {
+    TRACE_SPAN("load_usda_abbrev_cached");
+    {
+        FoodSnapshot snapshot(snapshot_path, path);
+        if (snapshot.ok()) {
+            return snapshot.to_food_vector();
+        }
+    }
+    return rebuild_food_snapshot(path, snapshot_path);
+}
+
 // Convenience function to compute the total kilocalories and protein
 // in a FoodVector. Those values are returned through the
 // first two pass-by-reference arguments.
@@ -165,6 +1184,7 @@ void sum_food_vector(int& total_kcal,
 // Convenience function to print out each food in a FoodVector,
 // followed by the total kilocalories and protein in it.
 void print_food_vector(const FoodVector& foods) {
+    TRACE_SPAN("print_food_vector");
     for (auto& food : foods) {
         std::cout << food->description()
         << " (100 g where each " << food->amount()
@@ -194,6 +1214,7 @@ std::unique_ptr<FoodVector> filter_food_vector(const FoodVector& source,
                                                int min_kcal,
                                                int max_kcal,
                                                int total_size) {
+    TRACE_SPAN("filter_food_vector");
     
     //cleaned FoodVector
     FoodVector cleaned;
@@ -211,56 +1232,239 @@ std::unique_ptr<FoodVector> filter_food_vector(const FoodVector& source,
     return ptr_best;
 }
 
+// The criteria of filter_food_vector, as a predicate that can be
+// pushed down into a streaming food source. A food matches when
+// min_kcal < kcal < max_kcal and its protein is non-negative, and
+// at most total_size foods are accepted.
+struct FoodFilter {
+    int min_kcal;
+    int max_kcal;
+    int total_size;
+    
+    FoodFilter(int min_kcal, int max_kcal, int total_size)
+    : min_kcal(min_kcal), max_kcal(max_kcal), total_size(total_size) { }
+    
+    bool matches(const Food& food) const {
+        return (food.kcal() > min_kcal) &&
+        (food.kcal() < max_kcal) &&
+        (food.protein_g() >= 0);
+    }
+};
+
+// Stream the valid foods of the ABBREV file at path, in file order,
+// calling visit(food) on each one until visit returns false. The file
+// is mapped rather than read, so stopping early only touches the
+// pages holding the lines visited so far. Unlike load_usda_abbrev,
+// lines after the point where visit stops are never looked at, so a
+// malformed line there is not detected. Returns false on I/O error or
+// when a malformed line is reached.
+bool stream_usda_abbrev(const std::string& path,
+                        const std::function<bool(const std::shared_ptr<Food>&)>& visit) {
+    MappedFile file(path);
+    if (!file.ok()) {
+        return false;
+    }
+    return scan_abbrev_buffer(file.begin(), file.end(), best_tokenizer_isa(), visit);
+}
+
+// Equivalent to filtering the result of load_usda_abbrev with
+// filter_food_vector(foods, filter.min_kcal, filter.max_kcal,
+// filter.total_size), but reads the file as a stream and stops as soon
+// as total_size foods have matched, so small inputs for exhaustive
+// search only read a few KB. Returns nullptr on I/O error.
+std::unique_ptr<FoodVector> load_filtered_usda_abbrev(const std::string& path,
+                                                      const FoodFilter& filter) {
+    std::unique_ptr<FoodVector> result(new FoodVector);
+    bool ok = stream_usda_abbrev(path, [&](const std::shared_ptr<Food>& food) {
+        if (result->size() < static_cast<size_t>(std::max(0, filter.total_size)) &&
+            filter.matches(*food)) {
+            result->push_back(food);
+        }
+        return result->size() < static_cast<size_t>(std::max(0, filter.total_size));
+    });
+    if (!ok) {
+        return std::unique_ptr<FoodVector>(nullptr);
+    }
+    return result;
+}
+
+// The kcal and protein columns of a FoodVector, copied out once so
+// that solvers can scan contiguous arrays instead of chasing a
+// shared_ptr per access.
+struct FoodColumns {
+    std::vector<int32_t> kcal;
+    std::vector<int32_t> protein_g;
+    
+    explicit FoodColumns(const FoodVector& foods) {
+        kcal.reserve(foods.size());
+        protein_g.reserve(foods.size());
+        for (auto& food : foods) {
+            kcal.push_back(food->kcal());
+            protein_g.push_back(food->protein_g());
+        }
+    }
+    
+    int size() const { return kcal.size(); }
+};
+
+// Compute the total kilocalories and protein of the rows of table
+// named by indices, like sum_food_vector does for a FoodVector.
+void sum_food_table(int& total_kcal,
+                    int& total_protein_g,
+                    const FoodTable& table,
+                    const std::vector<int>& indices) {
+    total_kcal = total_protein_g = 0;
+    for (int i : indices) {
+        total_kcal += table.kcal(i);
+        total_protein_g += table.protein_g(i);
+    }
+}
+
+// The order in which the greedy algorithm considers n foods whose
+// protein is given as a column: greatest protein first, and among
+// equal protein, lowest index first. This is the order in which the
+// original scan-and-erase loop (greedy_selection_quadratic) finds
+// them, since it keeps the remaining foods in input order and only
+// moves to a later food on strictly greater protein.
+std::vector<int> greedy_order(const int32_t* protein_g, int n) {
+    std::vector<int> order(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [protein_g](int a, int b) {
+        return protein_g[a] > protein_g[b];
+    });
+    return order;
+}
+
+// The greedy algorithm of greedy_max_protein over n foods whose kcal
+// and protein are given as columns, in O(n log n) time: the foods are
+// sorted once by greedy_order, then taken in a single pass whenever
+// they still fit. Picks exactly the same foods as
+// greedy_selection_quadratic.
+Selection greedy_selection(const int32_t* kcal, const int32_t* protein_g, int n, int total_kcal) {
+    TRACE_SPAN("greedy");
+    std::vector<int> chosen;
+    int result_cal = 0, result_protein = 0;
+    for (int food : greedy_order(protein_g, n)) {
+        if (result_cal + kcal[food] <= total_kcal) {
+            chosen.push_back(food);
+            result_cal += kcal[food];
+            result_protein += protein_g[food];
+        }
+    }
+    return Selection(chosen, result_cal, result_protein);
+}
+
+// The original O(n^2) greedy loop over columns, which rescans the
+// remaining foods for the greatest protein each round and erases the
+// chosen one. Kept as the reference that greedy_selection is checked
+// and benchmarked against.
+Selection greedy_selection_quadratic(const int32_t* kcal, const int32_t* protein_g, int n, int total_kcal) {
+    
+    // Indices of the foods not considered yet, in input order, which
+    // is the order foods_cpy keeps in greedy_max_protein.
+    std::vector<int> remaining(n);
+    for (int i = 0; i < n; i++) {
+        remaining[i] = i;
+    }
+    
+    std::vector<int> chosen;
+    int result_cal = 0, result_protein = 0;
+    while (!remaining.empty()) {
+        size_t max_index = 0;
+        for (size_t j = 1; j < remaining.size(); j++) {
+            if (protein_g[remaining[j]] > protein_g[remaining[max_index]]) {
+                max_index = j;
+            }
+        }
+        int food = remaining[max_index];
+        if (result_cal + kcal[food] <= total_kcal) {
+            chosen.push_back(food);
+            result_cal += kcal[food];
+            result_protein += protein_g[food];
+        }
+        remaining.erase(remaining.begin() + max_index);
+    }
+    return Selection(chosen, result_cal, result_protein);
+}
+
+// The exhaustive search of exhaustive_max_protein over n < 64 foods
+// whose kcal and protein are given as columns. Each subset's totals
+// are summed straight from the columns and only the best mask is
+// kept, so the search does not allocate.
+Selection exhaustive_selection(const int32_t* kcal, const int32_t* protein_g, int n, int total_kcal) {
+    TRACE_SPAN("exhaustive");
+    assert(n < 64);
+    
+    uint64_t best = 0;
+    int best_kcal = 0, best_protein = 0;
+    
+    for (uint64_t subset = 0; subset < (uint64_t(1) << n); subset++) {
+        int subset_kcal = 0, subset_protein = 0;
+        for (int i = 0; i < n; i++) {
+            if ((subset >> i) & 1) {
+                subset_kcal += kcal[i];
+                subset_protein += protein_g[i];
+            }
+        }
+        // Same rule as exhaustive_max_protein always had: an empty
+        // best is replaced by any subset that fits, otherwise only by
+        // one with strictly more protein.
+        if (subset_kcal <= total_kcal && (best == 0 || subset_protein > best_protein)) {
+            best = subset;
+            best_kcal = subset_kcal;
+            best_protein = subset_protein;
+        }
+    }
+    return Selection::from_mask(best, best_kcal, best_protein);
+}
+
+// greedy_max_protein, returning a Selection of foods instead of a
+// new FoodVector.
+Selection greedy_max_protein_selection(const FoodVector& foods, int total_kcal) {
+    FoodColumns columns(foods);
+    return greedy_selection(columns.kcal.data(), columns.protein_g.data(), columns.size(), total_kcal);
+}
+
+// exhaustive_max_protein, returning a Selection of foods instead of a
+// new FoodVector.
+Selection exhaustive_max_protein_selection(const FoodVector& foods, int total_kcal) {
+    FoodColumns columns(foods);
+    return exhaustive_selection(columns.kcal.data(), columns.protein_g.data(), columns.size(), total_kcal);
+}
+
+// greedy_max_protein over a FoodTable.
+Selection greedy_max_protein(const FoodTable& table, int total_kcal) {
+    return greedy_selection(table.kcal_data(), table.protein_g_data(), table.size(), total_kcal);
+}
+
+// exhaustive_max_protein over a FoodTable, which must have fewer than
+// 64 rows.
+Selection exhaustive_max_protein(const FoodTable& table, int total_kcal) {
+    return exhaustive_selection(table.kcal_data(), table.protein_g_data(), table.size(), total_kcal);
+}
+
 // Compute the optimal set of foods with a greedy
 // algorithm. Specifically, among the food items that fit within a
 // total_kcal calorie budget, choose the food whose protein is
 // greatest. Repeat until no more foods can be chosen, either because
 // we've run out of foods, or run out of calories.
 std::unique_ptr<FoodVector> greedy_max_protein(const FoodVector& foods, int total_kcal) {
+    TRACE_SPAN("greedy_max_protein");
     
     std::unique_ptr<FoodVector> result(new FoodVector);
     
-    //create copy of foods FoodVector
-    std::unique_ptr<FoodVector> foods_cpy(new FoodVector(foods));
-    
-    //initialize variables
-    int max_index = 0;
-    int max_protein = 0;
-    int calories = 0;
+    // Considering foods in greedy_order is the same as repeatedly
+    // choosing the remaining food with the greatest protein, but
+    // takes one sort instead of a scan and erase per food.
+    FoodColumns columns(foods);
     int result_cal = 0;
-    
-    while(!(*foods_cpy).empty()) {
-        //Set the highest protein food to first food in foods_cpy initially
-        max_protein = (*foods_cpy).at(0)->protein_g();
-        //Set calories to first food in foods_cpy
-        calories = (*foods_cpy).at(0)->kcal();
-        max_index = 0;
-        
-        //for each food
-        for(int j = 0; j < (*foods_cpy).size(); j++) {
-            //if the food's protein value is greater than the protein value in max_protein
-            if((*foods_cpy).at(j)->protein_g() > max_protein) {
-                //set the new max_protein value
-                max_protein = (*foods_cpy).at(j)->protein_g();
-                //record the index as well
-                max_index = j;
-                //set the calories of the food as well
-                calories = (*foods_cpy).at(j)->kcal();
-            }
+    for (int i : greedy_order(columns.protein_g.data(), columns.size())) {
+        if (result_cal + columns.kcal[i] <= total_kcal) {
+            result->push_back(foods[i]);
+            result_cal += columns.kcal[i];
         }
-        
-        if(result_cal + calories <= total_kcal) {
-            
-            result->push_back(std::shared_ptr<Food>(new Food((*foods_cpy).at(max_index)->description(),
-                                                             (*foods_cpy).at(max_index)->amount(),
-                                                             (*foods_cpy).at(max_index)->amount_g(),
-                                                             (*foods_cpy).at(max_index)->kcal(),
-                                                             (*foods_cpy).at(max_index)->protein_g())));
-            //add the calories of the food to the accumulator
-            result_cal += calories;
-        }
-        //Remove that food from foods_cpy FoodVector
-        (*foods_cpy).erase((*foods_cpy).begin() + max_index);
     }
     return result;
 }
@@ -271,51 +1475,1531 @@ std::unique_ptr<FoodVector> greedy_max_protein(const FoodVector& foods, int tota
 // total protein is greatest. To avoid overflow, the size of the foods
 // vector must be less than 64.
 std::unique_ptr<FoodVector> exhaustive_max_protein(const FoodVector& foods, int total_kcal) {
-    const int n = foods.size();
+    return exhaustive_max_protein_selection(foods, total_kcal).to_food_vector(foods);
+}
+
+// True when a subset with total protein protein and bitmask mask, that
+// fits in the budget, should replace the best fitting subset found so
+// far. This orders subsets the same way as scanning masks in
+// increasing order with exhaustive_max_protein's rule: more protein
+// wins; a non-empty subset beats the empty one; otherwise the lower
+// mask wins. Any enumeration order that uses it therefore finds the
+// same subset, which makes results reproducible.
+inline bool exhaustive_better(int protein, uint64_t mask, int best_protein, uint64_t best_mask) {
+    if (protein != best_protein) {
+        return protein > best_protein;
+    }
+    if ((mask == 0) != (best_mask == 0)) {
+        return best_mask == 0;
+    }
+    return mask < best_mask;
+}
+
+// The best fitting subset found so far by an exhaustive search,
+// starting from the empty subset.
+struct ExhaustiveBest {
+    uint64_t mask;
+    int kcal;
+    int protein_g;
+    
+    ExhaustiveBest() : mask(0), kcal(0), protein_g(0) { }
+    
+    // Consider a subset that fits in the budget.
+    void offer(uint64_t subset, int subset_kcal, int subset_protein) {
+        if (exhaustive_better(subset_protein, subset, protein_g, mask)) {
+            mask = subset;
+            kcal = subset_kcal;
+            protein_g = subset_protein;
+        }
+    }
+    
+    Selection selection() const { return Selection::from_mask(mask, kcal, protein_g); }
+};
+
+// Walk, in Gray-code order, the 2^m subsets that are base plus any
+// combination of foods 0 to m-1. base must have its low m bits clear,
+// and base_kcal and base_protein are its totals. Each step flips
+// exactly one food in or out of the subset, so its totals are updated
+// in O(1) rather than resummed in O(n), and nothing is allocated.
+// Every subset that fits in total_kcal, base included, is offered to
+// best.
+void exhaustive_gray_walk(const int32_t* kcal, const int32_t* protein_g, int m,
+                          uint64_t base, int base_kcal, int base_protein,
+                          int total_kcal, ExhaustiveBest& best) {
+    uint64_t subset = base;
+    int subset_kcal = base_kcal, subset_protein = base_protein;
+    if (subset_kcal <= total_kcal) {
+        best.offer(subset, subset_kcal, subset_protein);
+    }
+    const uint64_t count = uint64_t(1) << m;
+    for (uint64_t step = 1; step < count; step++) {
+        // Gray code step: flip the lowest set bit of the step number.
+        int food = __builtin_ctzll(step);
+        uint64_t bit = uint64_t(1) << food;
+        subset ^= bit;
+        if (subset & bit) {
+            subset_kcal += kcal[food];
+            subset_protein += protein_g[food];
+        } else {
+            subset_kcal -= kcal[food];
+            subset_protein -= protein_g[food];
+        }
+        if (subset_kcal <= total_kcal) {
+            best.offer(subset, subset_kcal, subset_protein);
+        }
+    }
+}
+
+// Exhaustive search over n < 64 foods whose kcal and protein are
+// given as columns, walking the subsets in Gray-code order with
+// exhaustive_gray_walk. Returns the same subset as
+// exhaustive_selection.
+Selection exhaustive_selection_gray(const int32_t* kcal, const int32_t* protein_g, int n, int total_kcal) {
+    TRACE_SPAN("exhaustive_gray");
     assert(n < 64);
+    ExhaustiveBest best;
+    exhaustive_gray_walk(kcal, protein_g, n, 0, 0, 0, total_kcal, best);
+    return best.selection();
+}
+
+// exhaustive_max_protein over a FoodTable, walking subsets in
+// Gray-code order.
+Selection exhaustive_max_protein_gray(const FoodTable& table, int total_kcal) {
+    return exhaustive_selection_gray(table.kcal_data(), table.protein_g_data(), table.size(), total_kcal);
+}
+
+// Same as exhaustive_max_protein, but walks subsets in Gray-code
+// order with O(1) work per subset, so n = 30 takes seconds. The
+// size of the foods vector must be less than 64.
+std::unique_ptr<FoodVector> exhaustive_max_protein_gray(const FoodVector& foods, int total_kcal) {
+    FoodColumns columns(foods);
+    return exhaustive_selection_gray(columns.kcal.data(), columns.protein_g.data(),
+                                     columns.size(), total_kcal).to_food_vector(foods);
+}
+
+// Number of worker threads to use when a caller asks for 0, meaning
+// one per hardware core.
+unsigned default_thread_count(unsigned thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return thread_count;
+}
+
+// Run task(t, worker) for every task number t in [0, task_count), on
+// thread_count worker threads numbered 0 to thread_count-1; the
+// calling thread is worker 0. Tasks are dealt out to per-worker
+// deques in contiguous blocks. Each worker pops tasks from the back
+// of its own deque, and when that runs dry, steals from the front of
+// the other workers' deques, so workers that finish early take over
+// the remaining work of slower ones.
+template <typename Task>
+void run_work_stealing(size_t task_count, unsigned thread_count, Task task) {
     
-    uint64_t MAX_POSSIBLE_SUBSETS = (long long)pow(2.0, n);      //define the max possible number of subsets for the outer loop.
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    for (unsigned w = 0; w < thread_count; w++) {
+        queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue));
+        for (size_t t = task_count * w / thread_count; t < task_count * (w + 1) / thread_count; t++) {
+            queues[w]->tasks.push_back(t);
+        }
+    }
     
-    //Return best vector containing subset of foods that has the highest total of protein
-    FoodVector best;
+    auto worker = [&](unsigned self) {
+        for (;;) {
+            size_t t = 0;
+            bool found = false;
+            {
+                std::lock_guard<std::mutex> guard(queues[self]->lock);
+                if (!queues[self]->tasks.empty()) {
+                    t = queues[self]->tasks.back();
+                    queues[self]->tasks.pop_back();
+                    found = true;
+                }
+            }
+            for (unsigned i = 1; !found && i < thread_count; i++) {
+                WorkerQueue& victim = *queues[(self + i) % thread_count];
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if (!victim.tasks.empty()) {
+                    t = victim.tasks.front();
+                    victim.tasks.pop_front();
+                    found = true;
+                }
+            }
+            if (!found) {
+                return;
+            }
+            TRACE_SPAN("task");
+            task(t, self);
+        }
+    };
     
-    //Cycle through every possible subset
-    for(uint64_t subset = 0; subset < MAX_POSSIBLE_SUBSETS; subset++) {
-        
-        //Create empty candidate vector for every iteration of outer loop (each subset possible)
-        FoodVector candidate;
-        int total_calories_can = 0;
-        int total_protein_can = 0;
-        int total_calories_best = 0;
-        int total_protein_best = 0;
-        
-        //For every bit that makes up the 64 bit binary representation of the outer loop int counter i value
-        for(uint64_t shift_num = 0; shift_num < n; shift_num++) {
-            /*Shift right for every bit (in binary representation of outer loop int counter i) and check if the food element is present in the subset (represented by the binary value of the outer loop's current iteration counter variable i).*/
-            if(((subset >> shift_num) & 1) == 1) {
-                candidate.push_back(foods[shift_num]);
+    // Spawned workers label their trace lanes; the calling thread
+    // keeps its own.
+    std::vector<std::thread> pool;
+    for (unsigned w = 1; w < thread_count; w++) {
+        pool.push_back(std::thread([&worker, w]() {
+            TRACE_THREAD_NAME("worker " + std::to_string(w));
+            worker(w);
+        }));
+    }
+    worker(0);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+// Exhaustive search over n < 64 foods whose kcal and protein are
+// given as columns, on thread_count threads (0 for one per core). The
+// mask space is split on its top bits into ranges, each a Gray-code
+// walk over the low bits, which are run by run_work_stealing. Every
+// worker keeps its own best, and the bests are merged with
+// exhaustive_better, so the result is the same subset as
+// exhaustive_selection no matter how many threads run.
+Selection exhaustive_selection_parallel(const int32_t* kcal, const int32_t* protein_g, int n,
+                                        int total_kcal, unsigned thread_count = 0) {
+    TRACE_SPAN("exhaustive_parallel");
+    assert(n < 64);
+    thread_count = default_thread_count(thread_count);
+    
+    // Enough ranges that stealing can even out the load, but each
+    // range still a sizable walk.
+    int high_bits = 0;
+    while (high_bits < n && high_bits < 16 && (uint64_t(1) << high_bits) < 16 * uint64_t(thread_count)) {
+        high_bits++;
+    }
+    const int low_bits = n - high_bits;
+    
+    std::vector<ExhaustiveBest> worker_best(thread_count);
+    run_work_stealing(size_t(1) << high_bits, thread_count, [&](size_t prefix, unsigned worker) {
+        uint64_t base = uint64_t(prefix) << low_bits;
+        int base_kcal = 0, base_protein = 0;
+        for (int food = low_bits; food < n; food++) {
+            if ((base >> food) & 1) {
+                base_kcal += kcal[food];
+                base_protein += protein_g[food];
             }
         }
-        
-        //Populate outer loop total_calories and total_protein with sums from candidate vector (subset)
-        //the variable arguments are passed by reference so they are updated within the function call.
-        sum_food_vector(total_calories_can, total_protein_can, candidate);
-        
-        //Find the same as above for best
-        sum_food_vector(total_calories_best, total_protein_best, best);
-        
-        /*If total_calories of current iteration candidate (subset) < the positive calorie budget "C" which is total_kcal*/
-        if(total_calories_can <= total_kcal) {
-            if(best.size() == 0 || (total_protein_can > total_protein_best)) {
-                //reassign new best
-                best = candidate;
+        // Walk with a local best, so that workers do not write to
+        // neighboring worker_best entries in the inner loop.
+        ExhaustiveBest best = worker_best[worker];
+        exhaustive_gray_walk(kcal, protein_g, low_bits, base, base_kcal, base_protein, total_kcal, best);
+        worker_best[worker] = best;
+    });
+    
+    ExhaustiveBest best;
+    for (auto& candidate : worker_best) {
+        best.offer(candidate.mask, candidate.kcal, candidate.protein_g);
+    }
+    return best.selection();
+}
+
+// exhaustive_max_protein over a FoodTable on thread_count threads (0
+// for one per core).
+Selection exhaustive_max_protein_parallel(const FoodTable& table, int total_kcal,
+                                          unsigned thread_count = 0) {
+    return exhaustive_selection_parallel(table.kcal_data(), table.protein_g_data(), table.size(),
+                                         total_kcal, thread_count);
+}
+
+// Same as exhaustive_max_protein, but searches on thread_count
+// threads (0 for one per core). Returns the same foods for any
+// thread count. The size of the foods vector must be less than 64.
+std::unique_ptr<FoodVector> exhaustive_max_protein_parallel(const FoodVector& foods, int total_kcal,
+                                                            unsigned thread_count = 0) {
+    FoodColumns columns(foods);
+    return exhaustive_selection_parallel(columns.kcal.data(), columns.protein_g.data(),
+                                         columns.size(), total_kcal, thread_count).to_food_vector(foods);
+}
+
+// The vectorized exhaustive search kernels below evaluate 2^L subsets
+// per instruction, one per vector lane. The low L foods are
+// enumerated once into per-lane partial sums, so lane j holds the
+// kcal and protein of the subset j of the low foods. The remaining
+// high foods are walked in Gray-code order as in
+// exhaustive_gray_walk, and each step broadcast-adds the high
+// subset's totals to the partial sums, compares against total_kcal,
+// and keeps a per-lane best. Ties within a lane go to the lowest high
+// mask, and the lanes are merged with exhaustive_better, so the
+// result is the same subset as exhaustive_selection. The high mask is
+// kept in an int32 lane, so n - L must be at most 31.
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// One AVX2 kernel step: evaluate the 8 subsets made of high mask high,
+// whose totals are high_kcal and high_protein, plus each subset of
+// the low foods, skipping lanes set in exclude, and update the
+// per-lane best protein and high mask.
+__attribute__((target("avx2")))
+inline void exhaustive_avx2_step(__m256i low_k, __m256i low_p, __m256i budget,
+                                 uint32_t high, int high_kcal, int high_protein, __m256i exclude,
+                                 __m256i& best_p, __m256i& best_high) {
+    const __m256i none = _mm256_set1_epi32(-1);
+    __m256i k = _mm256_add_epi32(low_k, _mm256_set1_epi32(high_kcal)),
+    p = _mm256_add_epi32(low_p, _mm256_set1_epi32(high_protein)),
+    h = _mm256_set1_epi32(high);
+    __m256i fits = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpgt_epi32(k, budget), exclude), none);
+    __m256i candidate = _mm256_blendv_epi8(none, p, fits);
+    __m256i lower_tie = _mm256_and_si256(_mm256_and_si256(fits, _mm256_cmpeq_epi32(candidate, best_p)),
+                                         _mm256_cmpgt_epi32(best_high, h));
+    __m256i better = _mm256_or_si256(_mm256_cmpgt_epi32(candidate, best_p), lower_tie);
+    best_p = _mm256_blendv_epi8(best_p, candidate, better);
+    best_high = _mm256_blendv_epi8(best_high, h, better);
+}
+
+// One AVX-512 kernel step, as exhaustive_avx2_step but for 16 lanes,
+// evaluating only the lanes set in include.
+__attribute__((target("avx512f")))
+inline void exhaustive_avx512_step(__m512i low_k, __m512i low_p, __m512i budget,
+                                   uint32_t high, int high_kcal, int high_protein, __mmask16 include,
+                                   __m512i& best_p, __m512i& best_high) {
+    __m512i k = _mm512_add_epi32(low_k, _mm512_set1_epi32(high_kcal)),
+    p = _mm512_add_epi32(low_p, _mm512_set1_epi32(high_protein)),
+    h = _mm512_set1_epi32(high);
+    __mmask16 fits = _mm512_mask_cmple_epi32_mask(include, k, budget);
+    __mmask16 better = _mm512_mask_cmpgt_epi32_mask(fits, p, best_p) |
+    (_mm512_mask_cmpeq_epi32_mask(fits, p, best_p) & _mm512_cmpgt_epi32_mask(best_high, h));
+    best_p = _mm512_mask_mov_epi32(best_p, better, p);
+    best_high = _mm512_mask_mov_epi32(best_high, better, h);
+}
+
+// AVX2 kernel, 8 subsets (L = 3) per step. Requires 3 <= n <= 34.
+__attribute__((target("avx2")))
+Selection exhaustive_selection_avx2(const int32_t* kcal, const int32_t* protein_g, int n, int total_kcal) {
+    const int low_bits = 3, lanes = 8;
+    const int high_bits = n - low_bits;
+    assert(high_bits >= 0 && high_bits <= 31);
+    
+    alignas(32) int32_t low_kcal[lanes], low_protein[lanes];
+    for (int j = 0; j < lanes; j++) {
+        low_kcal[j] = low_protein[j] = 0;
+        for (int i = 0; i < low_bits; i++) {
+            if ((j >> i) & 1) {
+                low_kcal[j] += kcal[i];
+                low_protein[j] += protein_g[i];
             }
         }
     }
-    //Generate a return unique_ptr<FoodVector> type of best
-    std::unique_ptr<FoodVector> ptr_best(new FoodVector(best));
+    const __m256i low_k = _mm256_load_si256(reinterpret_cast<const __m256i*>(low_kcal)),
+    low_p = _mm256_load_si256(reinterpret_cast<const __m256i*>(low_protein)),
+    budget = _mm256_set1_epi32(total_kcal);
     
-    return ptr_best;
+    // Lane best protein, -1 when nothing fits yet, and its high mask.
+    __m256i best_p = _mm256_set1_epi32(-1), best_high = _mm256_setzero_si256();
+    
+    // The empty subset is lane 0 of high mask 0; it is left out here
+    // and is the starting point of the merge below.
+    exhaustive_avx2_step(low_k, low_p, budget, 0, 0, 0, _mm256_setr_epi32(-1, 0, 0, 0, 0, 0, 0, 0),
+                         best_p, best_high);
+    const __m256i keep_all = _mm256_setzero_si256();
+    uint32_t high = 0;
+    int high_kcal = 0, high_protein = 0;
+    const uint64_t count = uint64_t(1) << high_bits;
+    for (uint64_t s = 1; s < count; s++) {
+        int bit = __builtin_ctzll(s);
+        int food = low_bits + bit;
+        high ^= uint32_t(1) << bit;
+        if ((high >> bit) & 1) {
+            high_kcal += kcal[food];
+            high_protein += protein_g[food];
+        } else {
+            high_kcal -= kcal[food];
+            high_protein -= protein_g[food];
+        }
+        exhaustive_avx2_step(low_k, low_p, budget, high, high_kcal, high_protein, keep_all,
+                             best_p, best_high);
+    }
+    
+    alignas(32) int32_t lane_p[lanes], lane_high[lanes];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lane_p), best_p);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lane_high), best_high);
+    ExhaustiveBest best;
+    for (int j = 0; j < lanes; j++) {
+        if (lane_p[j] >= 0) {
+            uint64_t h = uint32_t(lane_high[j]);
+            int subset_kcal = low_kcal[j];
+            for (int i = 0; i < high_bits; i++) {
+                if ((h >> i) & 1) {
+                    subset_kcal += kcal[low_bits + i];
+                }
+            }
+            best.offer((h << low_bits) | j, subset_kcal, lane_p[j]);
+        }
+    }
+    return best.selection();
 }
 
+// AVX-512 kernel, 16 subsets (L = 4) per step. Requires 4 <= n <= 35.
+__attribute__((target("avx512f")))
+Selection exhaustive_selection_avx512(const int32_t* kcal, const int32_t* protein_g, int n, int total_kcal) {
+    const int low_bits = 4, lanes = 16;
+    const int high_bits = n - low_bits;
+    assert(high_bits >= 0 && high_bits <= 31);
+    
+    alignas(64) int32_t low_kcal[lanes], low_protein[lanes];
+    for (int j = 0; j < lanes; j++) {
+        low_kcal[j] = low_protein[j] = 0;
+        for (int i = 0; i < low_bits; i++) {
+            if ((j >> i) & 1) {
+                low_kcal[j] += kcal[i];
+                low_protein[j] += protein_g[i];
+            }
+        }
+    }
+    const __m512i low_k = _mm512_load_si512(low_kcal),
+    low_p = _mm512_load_si512(low_protein),
+    budget = _mm512_set1_epi32(total_kcal);
+    
+    __m512i best_p = _mm512_set1_epi32(-1), best_high = _mm512_setzero_si512();
+    
+    // The empty subset is lane 0 of high mask 0; it is left out here
+    // and is the starting point of the merge below.
+    exhaustive_avx512_step(low_k, low_p, budget, 0, 0, 0, 0xFFFE, best_p, best_high);
+    uint32_t high = 0;
+    int high_kcal = 0, high_protein = 0;
+    const uint64_t count = uint64_t(1) << high_bits;
+    for (uint64_t s = 1; s < count; s++) {
+        int bit = __builtin_ctzll(s);
+        int food = low_bits + bit;
+        high ^= uint32_t(1) << bit;
+        if ((high >> bit) & 1) {
+            high_kcal += kcal[food];
+            high_protein += protein_g[food];
+        } else {
+            high_kcal -= kcal[food];
+            high_protein -= protein_g[food];
+        }
+        exhaustive_avx512_step(low_k, low_p, budget, high, high_kcal, high_protein, 0xFFFF,
+                               best_p, best_high);
+    }
+    
+    alignas(64) int32_t lane_p[lanes], lane_high[lanes];
+    _mm512_store_si512(lane_p, best_p);
+    _mm512_store_si512(lane_high, best_high);
+    ExhaustiveBest best;
+    for (int j = 0; j < lanes; j++) {
+        if (lane_p[j] >= 0) {
+            uint64_t h = uint32_t(lane_high[j]);
+            int subset_kcal = low_kcal[j];
+            for (int i = 0; i < high_bits; i++) {
+                if ((h >> i) & 1) {
+                    subset_kcal += kcal[low_bits + i];
+                }
+            }
+            best.offer((h << low_bits) | j, subset_kcal, lane_p[j]);
+        }
+    }
+    return best.selection();
+}
 
+#endif
+
+// The widest subset kernel the running CPU supports, detected once.
+SimdIsa best_subset_kernel_isa() {
+    static const SimdIsa best =
+    simd_isa_supported(SimdIsa::avx512) ? SimdIsa::avx512 :
+    simd_isa_supported(SimdIsa::avx2) ? SimdIsa::avx2 :
+    SimdIsa::scalar;
+    return best;
+}
+
+// Exhaustive search over n < 64 foods whose kcal and protein are
+// given as columns, with the vectorized kernel for isa, which must be
+// supported by the running CPU. Inputs outside the kernel's range of
+// n, and isas without a kernel, use exhaustive_selection_gray, the
+// scalar fallback. Returns the same subset as exhaustive_selection.
+Selection exhaustive_selection_simd(const int32_t* kcal, const int32_t* protein_g, int n, int total_kcal,
+                                    SimdIsa isa = best_subset_kernel_isa()) {
+    TRACE_SPAN("exhaustive_simd");
+#if defined(__x86_64__) || defined(__i386__)
+    if (isa == SimdIsa::avx512 && n >= 4 && n <= 35) {
+        return exhaustive_selection_avx512(kcal, protein_g, n, total_kcal);
+    }
+    if ((isa == SimdIsa::avx512 || isa == SimdIsa::avx2) && n >= 3 && n <= 34) {
+        return exhaustive_selection_avx2(kcal, protein_g, n, total_kcal);
+    }
+#endif
+    return exhaustive_selection_gray(kcal, protein_g, n, total_kcal);
+}
+
+// exhaustive_max_protein over a FoodTable, with the vectorized
+// subset kernel for isa.
+Selection exhaustive_max_protein_simd(const FoodTable& table, int total_kcal,
+                                      SimdIsa isa = best_subset_kernel_isa()) {
+    return exhaustive_selection_simd(table.kcal_data(), table.protein_g_data(), table.size(),
+                                     total_kcal, isa);
+}
+
+// Same as exhaustive_max_protein, but with the vectorized subset
+// kernel for isa. The size of the foods vector must be less than 64.
+std::unique_ptr<FoodVector> exhaustive_max_protein_simd(const FoodVector& foods, int total_kcal,
+                                                        SimdIsa isa = best_subset_kernel_isa()) {
+    FoodColumns columns(foods);
+    return exhaustive_selection_simd(columns.kcal.data(), columns.protein_g.data(),
+                                     columns.size(), total_kcal, isa).to_food_vector(foods);
+}
+
+// One subset of half of the foods, for meet-in-the-middle search.
+struct HalfSubset {
+    int kcal;
+    int protein_g;
+    uint64_t mask;
+};
+
+// Enumerate, in Gray-code order, the subsets of foods first to
+// first+count-1 whose kcal fits in total_kcal, calling
+// visit(subset) on each. Subset masks use the foods' positions in the
+// full input.
+template <typename Visitor>
+void enumerate_half_subsets(const int32_t* kcal, const int32_t* protein_g,
+                            int first, int count, int total_kcal, Visitor visit) {
+    HalfSubset subset = { 0, 0, 0 };
+    if (subset.kcal <= total_kcal) {
+        visit(subset);
+    }
+    for (uint64_t step = 1; step < (uint64_t(1) << count); step++) {
+        int food = first + __builtin_ctzll(step);
+        uint64_t bit = uint64_t(1) << food;
+        subset.mask ^= bit;
+        if (subset.mask & bit) {
+            subset.kcal += kcal[food];
+            subset.protein_g += protein_g[food];
+        } else {
+            subset.kcal -= kcal[food];
+            subset.protein_g -= protein_g[food];
+        }
+        if (subset.kcal <= total_kcal) {
+            visit(subset);
+        }
+    }
+}
+
+// Default limit on the memory meet_in_the_middle_selection may use
+// for the high half's subsets.
+const size_t MEET_IN_THE_MIDDLE_MAX_BYTES = size_t(1) << 30;
+
+// Exact meet-in-the-middle search over n < 64 foods whose kcal and
+// protein are given as columns, in O(2^(n/2) log 2^(n/2)) time and
+// O(2^(n/2)) memory instead of O(2^n). The foods are split into a low
+// and a high half. The high half's fitting subsets are sorted by kcal
+// and pruned to the ones that are not dominated, i.e. no subset with
+// at most as many kcal has as much protein, which leaves protein
+// strictly increasing with kcal. Each fitting subset of the low half
+// is then answered with a binary search for the largest high subset
+// that fits in the rest of the budget. The total protein is the same
+// as exhaustive_selection's; among several optimal subsets, the one
+// returned may differ, but is chosen deterministically with
+// exhaustive_better among those the search considers.
+//
+// Only the high subsets that fit the budget are stored, sizeof
+// (HalfSubset) bytes each, but in the worst case that is all
+// 2^(n - n/2) of them: 32 GiB for n = 62. When that worst case is
+// over max_bytes, the fitting subsets are counted first, and if they
+// need more than max_bytes, the search is not run: an empty Selection
+// is returned and *within_memory set to false. within_memory may be
+// nullptr. For scale, the first 62 foods of ABBREV.txt with a 2500
+// kcal budget have about 60 million fitting high subsets, or 950 MB.
+Selection meet_in_the_middle_selection(const int32_t* kcal, const int32_t* protein_g, int n, int total_kcal,
+                                       bool* within_memory = nullptr,
+                                       size_t max_bytes = MEET_IN_THE_MIDDLE_MAX_BYTES) {
+    TRACE_SPAN("meet_in_the_middle");
+    assert(n < 64);
+    
+    const int low_count = n / 2, high_count = n - low_count;
+    
+    uint64_t high_size = uint64_t(1) << high_count;
+    if (high_size > max_bytes / sizeof(HalfSubset)) {
+        high_size = 0;
+        enumerate_half_subsets(kcal, protein_g, low_count, high_count, total_kcal,
+                               [&](const HalfSubset&) { high_size++; });
+    }
+    if (within_memory) {
+        *within_memory = (high_size <= max_bytes / sizeof(HalfSubset));
+    }
+    if (high_size > max_bytes / sizeof(HalfSubset)) {
+        return Selection();
+    }
+    
+    std::vector<HalfSubset> high;
+    high.reserve(high_size);
+    enumerate_half_subsets(kcal, protein_g, low_count, high_count, total_kcal,
+                           [&](const HalfSubset& subset) { high.push_back(subset); });
+    std::sort(high.begin(), high.end(), [](const HalfSubset& a, const HalfSubset& b) {
+        if (a.kcal != b.kcal) {
+            return a.kcal < b.kcal;
+        }
+        if (a.protein_g != b.protein_g) {
+            return a.protein_g > b.protein_g;
+        }
+        return a.mask < b.mask;
+    });
+    // Prune to the non-dominated subsets in place, so the search never
+    // holds two copies of the high half.
+    std::vector<HalfSubset>& frontier = high;
+    size_t kept = 0;
+    for (size_t i = 0; i < high.size(); i++) {
+        if (kept == 0 || high[i].protein_g > high[kept - 1].protein_g) {
+            high[kept++] = high[i];
+        }
+    }
+    high.resize(kept);
+    
+    ExhaustiveBest best;
+    if (frontier.empty()) {
+        // Nothing fits, not even the empty subset.
+        return best.selection();
+    }
+    enumerate_half_subsets(kcal, protein_g, 0, low_count, total_kcal, [&](const HalfSubset& low) {
+        int remaining = total_kcal - low.kcal;
+        auto after = std::upper_bound(frontier.begin(), frontier.end(), remaining,
+                                      [](int budget, const HalfSubset& subset) {
+                                          return budget < subset.kcal;
+                                      });
+        // The empty high subset has 0 kcal and fits any remaining
+        // budget, so after is never frontier.begin().
+        const HalfSubset& match = *(after - 1);
+        best.offer(low.mask | match.mask, low.kcal + match.kcal, low.protein_g + match.protein_g);
+    });
+    return best.selection();
+}
+
+// Exact solution over a FoodTable by meet-in-the-middle search, which
+// must have fewer than 64 rows. See meet_in_the_middle_selection for
+// within_memory and max_bytes.
+Selection meet_in_the_middle_max_protein(const FoodTable& table, int total_kcal,
+                                         bool* within_memory = nullptr,
+                                         size_t max_bytes = MEET_IN_THE_MIDDLE_MAX_BYTES) {
+    return meet_in_the_middle_selection(table.kcal_data(), table.protein_g_data(), table.size(), total_kcal,
+                                        within_memory, max_bytes);
+}
+
+// Drop-in alternative to exhaustive_max_protein that finds a subset
+// with the same, optimal, total protein by meet-in-the-middle search,
+// in O(2^(n/2)) rather than O(2^n) time. The size of the foods vector
+// must be less than 64. Memory also grows as 2^(n/2), so from about
+// 50 foods on it depends on the budget; returns nullptr when the
+// search would need more than max_bytes.
+std::unique_ptr<FoodVector> meet_in_the_middle_max_protein(const FoodVector& foods, int total_kcal,
+                                                           size_t max_bytes = MEET_IN_THE_MIDDLE_MAX_BYTES) {
+    FoodColumns columns(foods);
+    bool within_memory;
+    Selection selection = meet_in_the_middle_selection(columns.kcal.data(), columns.protein_g.data(),
+                                                       columns.size(), total_kcal, &within_memory, max_bytes);
+    return within_memory ? selection.to_food_vector(foods) : nullptr;
+}
+
+// Optional limits on a branch-and-bound search. Zero means no limit.
+struct BranchAndBoundLimits {
+    uint64_t node_limit;
+    double time_limit_seconds;
+    
+    BranchAndBoundLimits(uint64_t node_limit = 0, double time_limit_seconds = 0)
+    : node_limit(node_limit), time_limit_seconds(time_limit_seconds) { }
+};
+
+// Statistics of a branch-and-bound search.
+struct BranchAndBoundStats {
+    // Search tree nodes visited, and subtrees pruned by the bound.
+    uint64_t nodes;
+    uint64_t prunes;
+    // Total search time, and the time at which the returned solution
+    // was found; 0 when the greedy starting solution was already
+    // optimal.
+    double seconds;
+    double seconds_to_best;
+    // Proven upper bound on the optimal protein. Equal to the returned
+    // solution's protein when the search ran to completion.
+    int upper_bound;
+    // True when the search ran to completion, so the returned
+    // solution is optimal.
+    bool optimal;
+    
+    BranchAndBoundStats()
+    : nodes(0), prunes(0), seconds(0), seconds_to_best(0), upper_bound(0), optimal(false) { }
+};
+
+// Exact depth-first branch-and-bound search over n foods whose kcal
+// and protein are given as columns, for inputs of hundreds of foods
+// or more. Foods that can never help (over budget, or no protein) are
+// dropped and free foods with protein are always taken. The rest are
+// ordered by protein per kcal, and each node is bounded by the
+// fractional-knapsack (LP relaxation) value of filling the remaining
+// budget greedily in that order. The search starts from the
+// greedy_selection answer as the incumbent and prunes any subtree
+// whose bound cannot beat it. When a limit in limits stops the search
+// early, the best solution so far is returned, and stats->upper_bound
+// bounds how far it can be from optimal. stats may be nullptr.
+Selection branch_and_bound_selection(const int32_t* kcal, const int32_t* protein_g, int n, int total_kcal,
+                                     const BranchAndBoundLimits& limits = BranchAndBoundLimits(),
+                                     BranchAndBoundStats* stats = nullptr) {
+    TRACE_SPAN("branch_and_bound");
+    
+    auto start = std::chrono::steady_clock::now();
+    auto seconds_since_start = [&]() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    
+    BranchAndBoundStats local_stats;
+    BranchAndBoundStats& st = stats ? *stats : local_stats;
+    st = BranchAndBoundStats();
+    
+    Selection incumbent = greedy_selection(kcal, protein_g, n, total_kcal);
+    if (total_kcal < 0) {
+        st.optimal = true;
+        return incumbent;
+    }
+    
+    // Free foods are always taken; the rest are branched on, densest
+    // first.
+    std::vector<int> base, items;
+    int base_protein = 0;
+    for (int i = 0; i < n; i++) {
+        if (protein_g[i] <= 0 || kcal[i] > total_kcal) {
+            continue;
+        }
+        if (kcal[i] == 0) {
+            base.push_back(i);
+            base_protein += protein_g[i];
+        } else {
+            items.push_back(i);
+        }
+    }
+    std::stable_sort(items.begin(), items.end(), [&](int a, int b) {
+        return int64_t(protein_g[a]) * kcal[b] > int64_t(protein_g[b]) * kcal[a];
+    });
+    const int m = items.size();
+    std::vector<int64_t> prefix_kcal(m + 1, 0), prefix_protein(m + 1, 0);
+    for (int j = 0; j < m; j++) {
+        prefix_kcal[j + 1] = prefix_kcal[j] + kcal[items[j]];
+        prefix_protein[j + 1] = prefix_protein[j] + protein_g[items[j]];
+    }
+    
+    // LP relaxation bound on the protein that items j..m-1 can add
+    // within capacity: whole items while they fit, then a fraction of
+    // the next one, rounded down since protein totals are integers.
+    auto bound = [&](int j, int capacity) -> int64_t {
+        auto stop = std::upper_bound(prefix_kcal.begin() + j, prefix_kcal.end(),
+                                     prefix_kcal[j] + capacity);
+        int full = (stop - prefix_kcal.begin()) - 1;
+        int64_t value = prefix_protein[full] - prefix_protein[j];
+        if (full < m) {
+            int64_t left = capacity - (prefix_kcal[full] - prefix_kcal[j]);
+            value += left * protein_g[items[full]] / kcal[items[full]];
+        }
+        return value;
+    };
+    
+    // Depth-first search with an explicit stack, so the depth is not
+    // limited by the call stack and no call is made per node. A node
+    // has decided items 0..j-1, with capacity kcal left and protein
+    // gained so far on top of base_protein; took is whether it took
+    // item j-1. Since nodes are visited in preorder, taken[0..j-1]
+    // always holds the decisions on the path to the current node.
+    struct Node {
+        int j;
+        int capacity;
+        int protein;
+        bool took;
+    };
+    std::vector<Node> stack;
+    stack.reserve(m + 2);
+    stack.push_back(Node{ 0, total_kcal, 0, false });
+    std::vector<char> taken(m, 0);
+    std::vector<int> best_path;
+    int best_protein = incumbent.total_protein_g();
+    bool improved = false;
+    bool stopped = false;
+    int64_t open_bound = 0;
+    
+    while (!stack.empty()) {
+        const Node node = stack.back();
+        stack.pop_back();
+        const int j = node.j;
+        int64_t upper = base_protein + node.protein + bound(j, node.capacity);
+        if (stopped) {
+            open_bound = std::max(open_bound, upper);
+            continue;
+        }
+        st.nodes++;
+        if ((limits.node_limit && st.nodes >= limits.node_limit) ||
+            (limits.time_limit_seconds > 0 && (st.nodes & 1023) == 0 &&
+             seconds_since_start() >= limits.time_limit_seconds)) {
+            stopped = true;
+            open_bound = std::max(open_bound, upper);
+            continue;
+        }
+        if (j > 0) {
+            taken[j - 1] = node.took;
+        }
+        if (base_protein + node.protein > best_protein) {
+            best_protein = base_protein + node.protein;
+            best_path.clear();
+            for (int k = 0; k < j; k++) {
+                if (taken[k]) {
+                    best_path.push_back(items[k]);
+                }
+            }
+            improved = true;
+            st.seconds_to_best = seconds_since_start();
+        }
+        if (j == m || upper <= best_protein) {
+            if (j < m) {
+                st.prunes++;
+            }
+            continue;
+        }
+        // Push the branch without item j first, so the branch taking
+        // it is searched first.
+        int food = items[j];
+        stack.push_back(Node{ j + 1, node.capacity, node.protein, false });
+        if (kcal[food] <= node.capacity) {
+            stack.push_back(Node{ j + 1, node.capacity - kcal[food], node.protein + protein_g[food], true });
+        }
+    }
+    
+    st.optimal = !stopped;
+    st.upper_bound = stopped ? std::max<int64_t>(best_protein, open_bound) : best_protein;
+    st.seconds = seconds_since_start();
+    
+    if (!improved) {
+        return incumbent;
+    }
+    std::vector<int> chosen = base;
+    chosen.insert(chosen.end(), best_path.begin(), best_path.end());
+    int chosen_kcal = 0;
+    for (int i : chosen) {
+        chosen_kcal += kcal[i];
+    }
+    return Selection(chosen, chosen_kcal, best_protein);
+}
+
+// Exact solution over a FoodTable by branch and bound.
+Selection branch_and_bound_max_protein(const FoodTable& table, int total_kcal,
+                                       const BranchAndBoundLimits& limits = BranchAndBoundLimits(),
+                                       BranchAndBoundStats* stats = nullptr) {
+    return branch_and_bound_selection(table.kcal_data(), table.protein_g_data(), table.size(),
+                                      total_kcal, limits, stats);
+}
+
+// Compute an optimal set of foods, like exhaustive_max_protein, by
+// branch and bound, which handles hundreds of foods. See
+// branch_and_bound_selection for limits and stats.
+std::unique_ptr<FoodVector> branch_and_bound_max_protein(const FoodVector& foods, int total_kcal,
+                                                         const BranchAndBoundLimits& limits = BranchAndBoundLimits(),
+                                                         BranchAndBoundStats* stats = nullptr) {
+    FoodColumns columns(foods);
+    return branch_and_bound_selection(columns.kcal.data(), columns.protein_g.data(), columns.size(),
+                                      total_kcal, limits, stats).to_food_vector(foods);
+}
+
+// A compact rows x columns matrix of bits, zero-initialized.
+class BitMatrix {
+public:
+    BitMatrix(size_t rows, size_t columns)
+    : _words_per_row((columns + 63) / 64), _bits(rows * _words_per_row, 0) { }
+    
+    bool get(size_t row, size_t column) const {
+        return (_bits[row * _words_per_row + column / 64] >> (column % 64)) & 1;
+    }
+    void set(size_t row, size_t column) {
+        _bits[row * _words_per_row + column / 64] |= uint64_t(1) << (column % 64);
+    }
+    
+    // Memory used by the bits, in bytes.
+    size_t bytes() const { return _bits.size() * sizeof(uint64_t); }
+    
+private:
+    size_t _words_per_row;
+    std::vector<uint64_t> _bits;
+};
+
+// Exact 0/1 knapsack dynamic programming over n foods whose kcal and
+// protein are given as columns, in O(n * total_kcal) time. A single
+// rolling table holds, for every budget c up to total_kcal, the most
+// protein of any subset of the foods seen so far with at most c kcal.
+// Adding food i updates it from high budgets to low. Whether food i
+// improved budget c is recorded in an n x (total_kcal + 1) bit
+// matrix, which is walked backwards from the full budget to recover
+// the chosen foods.
+Selection dynamic_programming_selection(const int32_t* kcal, const int32_t* protein_g, int n, int total_kcal) {
+    TRACE_SPAN("dynamic_programming");
+    if (total_kcal < 0) {
+        return Selection();
+    }
+    
+    std::vector<int> best(total_kcal + 1, 0);
+    BitMatrix taken(n, total_kcal + 1);
+    for (int i = 0; i < n; i++) {
+        const int weight = kcal[i], value = protein_g[i];
+        if (value <= 0 || weight > total_kcal) {
+            continue;
+        }
+        for (int c = total_kcal; c >= weight; c--) {
+            int with = best[c - weight] + value;
+            if (with > best[c]) {
+                best[c] = with;
+                taken.set(i, c);
+            }
+        }
+    }
+    
+    std::vector<int> chosen;
+    int c = total_kcal, chosen_kcal = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        if (taken.get(i, c)) {
+            chosen.push_back(i);
+            c -= kcal[i];
+            chosen_kcal += kcal[i];
+        }
+    }
+    return Selection(chosen, chosen_kcal, best[total_kcal]);
+}
+
+// Exact solution over a FoodTable by dynamic programming over the
+// calorie budget.
+Selection dynamic_programming_max_protein(const FoodTable& table, int total_kcal) {
+    return dynamic_programming_selection(table.kcal_data(), table.protein_g_data(), table.size(), total_kcal);
+}
+
+// Compute an optimal set of foods, like exhaustive_max_protein, by
+// dynamic programming over the calorie budget, in O(n * total_kcal)
+// time and O(n * total_kcal) bits of memory, so even the whole USDA
+// database can be solved exactly.
+std::unique_ptr<FoodVector> dynamic_programming_max_protein(const FoodVector& foods, int total_kcal) {
+    FoodColumns columns(foods);
+    return dynamic_programming_selection(columns.kcal.data(), columns.protein_g.data(),
+                                         columns.size(), total_kcal).to_food_vector(foods);
+}
+
+// Fill best[0..capacity] with the most protein any subset of the
+// foods items[first..last) can have within each budget, the rolling
+// table of dynamic_programming_selection without the choice matrix.
+void knapsack_table(const int32_t* kcal, const int32_t* protein_g,
+                    const std::vector<int>& items, size_t first, size_t last,
+                    int capacity, std::vector<int>& best) {
+    best.assign(capacity + 1, 0);
+    for (size_t j = first; j < last; j++) {
+        const int weight = kcal[items[j]], value = protein_g[items[j]];
+        for (int c = capacity; c >= weight; c--) {
+            best[c] = std::max(best[c], best[c - weight] + value);
+        }
+    }
+}
+
+// Add to chosen an optimal subset of items[first..last) within
+// capacity, by Hirschberg-style divide and conquer: tabulate the best
+// protein for every budget in each half, pick the split of capacity
+// between the halves that maximizes the sum, and recurse into each
+// half with its share. Only two O(capacity) tables are live at a time.
+void knapsack_divide_and_conquer(const int32_t* kcal, const int32_t* protein_g,
+                                 const std::vector<int>& items, size_t first, size_t last,
+                                 int capacity, std::vector<int>& chosen) {
+    if (first == last || capacity < 0) {
+        return;
+    }
+    if (last - first == 1) {
+        if (kcal[items[first]] <= capacity) {
+            chosen.push_back(items[first]);
+        }
+        return;
+    }
+    
+    size_t mid = first + (last - first) / 2;
+    int split = 0;
+    {
+        std::vector<int> low, high;
+        knapsack_table(kcal, protein_g, items, first, mid, capacity, low);
+        knapsack_table(kcal, protein_g, items, mid, last, capacity, high);
+        int best = -1;
+        for (int c = 0; c <= capacity; c++) {
+            if (low[c] + high[capacity - c] > best) {
+                best = low[c] + high[capacity - c];
+                split = c;
+            }
+        }
+    }
+    knapsack_divide_and_conquer(kcal, protein_g, items, first, mid, split, chosen);
+    knapsack_divide_and_conquer(kcal, protein_g, items, mid, last, capacity - split, chosen);
+}
+
+// Exact 0/1 knapsack over n foods whose kcal and protein are given as
+// columns, like dynamic_programming_selection, but in O(total_kcal)
+// memory independent of n: the chosen foods are recovered by
+// knapsack_divide_and_conquer instead of from a choice matrix, for
+// roughly twice the compute. Use this mode when n * total_kcal bits
+// would not fit in memory.
+Selection dynamic_programming_linear_selection(const int32_t* kcal, const int32_t* protein_g, int n,
+                                               int total_kcal) {
+    TRACE_SPAN("dynamic_programming_linear");
+    if (total_kcal < 0) {
+        return Selection();
+    }
+    std::vector<int> items;
+    for (int i = 0; i < n; i++) {
+        if (protein_g[i] > 0 && kcal[i] <= total_kcal) {
+            items.push_back(i);
+        }
+    }
+    std::vector<int> chosen;
+    knapsack_divide_and_conquer(kcal, protein_g, items, 0, items.size(), total_kcal, chosen);
+    int chosen_kcal = 0, chosen_protein = 0;
+    for (int i : chosen) {
+        chosen_kcal += kcal[i];
+        chosen_protein += protein_g[i];
+    }
+    return Selection(chosen, chosen_kcal, chosen_protein);
+}
+
+// Exact solution over a FoodTable by linear-memory dynamic
+// programming.
+Selection dynamic_programming_linear_max_protein(const FoodTable& table, int total_kcal) {
+    return dynamic_programming_linear_selection(table.kcal_data(), table.protein_g_data(), table.size(),
+                                                total_kcal);
+}
+
+// Same as dynamic_programming_max_protein, but in O(total_kcal)
+// memory regardless of the number of foods.
+std::unique_ptr<FoodVector> dynamic_programming_linear_max_protein(const FoodVector& foods, int total_kcal) {
+    FoodColumns columns(foods);
+    return dynamic_programming_linear_selection(columns.kcal.data(), columns.protein_g.data(),
+                                                columns.size(), total_kcal).to_food_vector(foods);
+}
+
+// Exact 0/1 knapsack over n foods whose kcal and protein are given as
+// columns, with the dual table indexed by protein: for every protein
+// total p up to the sum of all usable protein, the fewest kcal of any
+// subset with exactly p grams of protein. The answer is the largest p
+// whose kcal fit in total_kcal. Takes O(n * P) time and an n x (P+1)
+// choice bit matrix, where P is the protein sum, so it beats
+// dynamic_programming_selection when P is much smaller than the
+// budget.
+Selection dynamic_programming_by_protein_selection(const int32_t* kcal, const int32_t* protein_g, int n,
+                                                   int total_kcal) {
+    TRACE_SPAN("dynamic_programming_by_protein");
+    if (total_kcal < 0) {
+        return Selection();
+    }
+    int total_protein = 0;
+    for (int i = 0; i < n; i++) {
+        if (protein_g[i] > 0 && kcal[i] <= total_kcal) {
+            total_protein += protein_g[i];
+        }
+    }
+    
+    const int64_t unreachable = std::numeric_limits<int64_t>::max() / 2;
+    std::vector<int64_t> min_kcal(total_protein + 1, unreachable);
+    min_kcal[0] = 0;
+    BitMatrix taken(n, total_protein + 1);
+    int reached = 0;
+    for (int i = 0; i < n; i++) {
+        const int weight = kcal[i], value = protein_g[i];
+        if (value <= 0 || weight > total_kcal) {
+            continue;
+        }
+        reached += value;
+        for (int p = reached; p >= value; p--) {
+            int64_t with = min_kcal[p - value] + weight;
+            if (with < min_kcal[p]) {
+                min_kcal[p] = with;
+                taken.set(i, p);
+            }
+        }
+    }
+    
+    int p = total_protein;
+    while (min_kcal[p] > total_kcal) {
+        p--;
+    }
+    const int best_protein = p;
+    std::vector<int> chosen;
+    int chosen_kcal = 0;
+    for (int i = n - 1; i >= 0 && p > 0; i--) {
+        if (taken.get(i, p)) {
+            chosen.push_back(i);
+            p -= protein_g[i];
+            chosen_kcal += kcal[i];
+        }
+    }
+    return Selection(chosen, chosen_kcal, best_protein);
+}
+
+// Which table a dynamic programming solver indexed its table by.
+enum class DpIndex { kcal, protein };
+
+// Human-readable name of a DpIndex.
+const char* dp_index_name(DpIndex index) {
+    return (index == DpIndex::kcal) ? "kcal" : "protein";
+}
+
+// Exact 0/1 knapsack over n foods whose kcal and protein are given as
+// columns, with whichever dynamic programming table is smaller: one
+// indexed by kcal, whose size is the budget (or the kcal sum, if
+// smaller), or one indexed by protein, whose size is the protein sum.
+// Only foods that fit the budget and have protein are counted. The
+// choice is reported through index_used when it is not nullptr; a
+// negative budget, which nothing fits, builds no table and reports
+// DpIndex::kcal.
+Selection dual_dynamic_programming_selection(const int32_t* kcal, const int32_t* protein_g, int n,
+                                             int total_kcal, DpIndex* index_used = nullptr) {
+    if (index_used) {
+        *index_used = DpIndex::kcal;
+    }
+    if (total_kcal < 0) {
+        return Selection();
+    }
+    int64_t kcal_sum = 0, protein_sum = 0;
+    for (int i = 0; i < n; i++) {
+        if (protein_g[i] > 0 && kcal[i] <= total_kcal) {
+            kcal_sum += kcal[i];
+            protein_sum += protein_g[i];
+        }
+    }
+    int64_t kcal_table = std::min<int64_t>(total_kcal, kcal_sum);
+    DpIndex index = (protein_sum < kcal_table) ? DpIndex::protein : DpIndex::kcal;
+    if (index_used) {
+        *index_used = index;
+    }
+    if (index == DpIndex::protein) {
+        return dynamic_programming_by_protein_selection(kcal, protein_g, n, total_kcal);
+    }
+    // With a budget above the kcal sum every usable food fits, and the
+    // smaller budget gives the same answer in a smaller table.
+    return dynamic_programming_selection(kcal, protein_g, n, kcal_table);
+}
+
+// Exact solution over a FoodTable by dynamic programming over kcal or
+// protein, whichever table is smaller.
+Selection dual_dynamic_programming_max_protein(const FoodTable& table, int total_kcal,
+                                               DpIndex* index_used = nullptr) {
+    return dual_dynamic_programming_selection(table.kcal_data(), table.protein_g_data(), table.size(),
+                                              total_kcal, index_used);
+}
+
+// Compute an optimal set of foods by dynamic programming indexed by
+// kcal or by protein, whichever makes the smaller table. Large
+// budgets over foods with little protein are solved in time
+// proportional to the protein sum instead of the budget.
+std::unique_ptr<FoodVector> dual_dynamic_programming_max_protein(const FoodVector& foods, int total_kcal,
+                                                                 DpIndex* index_used = nullptr) {
+    FoodColumns columns(foods);
+    return dual_dynamic_programming_selection(columns.kcal.data(), columns.protein_g.data(),
+                                              columns.size(), total_kcal, index_used).to_food_vector(foods);
+}
+
+// The non-dominated (kcal, protein) frontier of every subset of a
+// set of foods, up to a largest budget max_kcal, built once by
+// dynamic programming over the budget, or only up to the kcal sum of
+// the foods that can help when that is smaller. Point j is the cheapest kcal
+// at which point_protein_g(j) grams of protein can be had, and both
+// columns strictly increase with j, so the most protein for any
+// budget is a binary search. The choice bit matrix of the dynamic
+// program is kept so the foods behind any point can be recovered.
+// Every query is const and touches no shared mutable state, so one
+// frontier can be shared read-only by any number of threads.
+class ProteinFrontier {
+private:
+    int _max_kcal;
+    int _table_kcal;
+    std::vector<int32_t> _kcal;
+    std::vector<int> _point_kcal;
+    std::vector<int> _point_protein_g;
+    BitMatrix _taken;
+    
+    // Index of the last point within total_kcal, or -1 if even the
+    // empty point is out of reach.
+    int point_within(int total_kcal) const {
+        auto after = std::upper_bound(_point_kcal.begin(), _point_kcal.end(), total_kcal);
+        return int(after - _point_kcal.begin()) - 1;
+    }
+    
+public:
+    // Build the frontier of n foods whose kcal and protein are given
+    // as columns, for budgets up to max_kcal. When every food with
+    // protein fits within max_kcal at once, the frontier answers every
+    // budget, and max_kcal() is INT_MAX.
+    ProteinFrontier(const int32_t* kcal, const int32_t* protein_g, int n, int max_kcal)
+    : _kcal(kcal, kcal + n), _taken(0, 0) {
+        TRACE_SPAN("protein_frontier");
+        max_kcal = std::max(max_kcal, 0);
+        int64_t kcal_sum = 0, usable_kcal_sum = 0;
+        for (int i = 0; i < n; i++) {
+            if (protein_g[i] > 0) {
+                kcal_sum += kcal[i];
+                if (kcal[i] <= max_kcal) {
+                    usable_kcal_sum += kcal[i];
+                }
+            }
+        }
+        // Past the kcal sum of the foods that fit max_kcal, every one
+        // of them fits, so a larger table would only repeat its last
+        // entry.
+        _max_kcal = (kcal_sum <= max_kcal) ? std::numeric_limits<int>::max() : max_kcal;
+        _table_kcal = int(std::min<int64_t>(max_kcal, usable_kcal_sum));
+        _taken = BitMatrix(n, _table_kcal + 1);
+        std::vector<int> best(_table_kcal + 1, 0);
+        for (int i = 0; i < n; i++) {
+            const int weight = kcal[i], value = protein_g[i];
+            if (value <= 0 || weight > _table_kcal) {
+                continue;
+            }
+            for (int c = _table_kcal; c >= weight; c--) {
+                int with = best[c - weight] + value;
+                if (with > best[c]) {
+                    best[c] = with;
+                    _taken.set(i, c);
+                }
+            }
+        }
+        // best never decreases with c; each budget where it rises is
+        // the cheapest way to that much protein.
+        for (int c = 0; c <= _table_kcal; c++) {
+            if (_point_protein_g.empty() || best[c] > _point_protein_g.back()) {
+                _point_kcal.push_back(c);
+                _point_protein_g.push_back(best[c]);
+            }
+        }
+    }
+    
+    ProteinFrontier(const FoodTable& table, int max_kcal)
+    : ProteinFrontier(table.kcal_data(), table.protein_g_data(), table.size(), max_kcal) { }
+    
+    ProteinFrontier(const FoodVector& foods, int max_kcal)
+    : ProteinFrontier(FoodColumns(foods), max_kcal) { }
+    
+    ProteinFrontier(const FoodColumns& columns, int max_kcal)
+    : ProteinFrontier(columns.kcal.data(), columns.protein_g.data(), columns.size(), max_kcal) { }
+    
+    // Largest budget the frontier answers. A larger budget might fit
+    // foods the frontier left out, so querying one is an error.
+    int max_kcal() const { return _max_kcal; }
+    
+    // Whether the frontier answers total_kcal.
+    bool covers(int total_kcal) const { return total_kcal <= _max_kcal; }
+    
+    // Number of frontier points, counting the empty selection.
+    size_t size() const { return _point_kcal.size(); }
+    
+    int point_kcal(size_t j) const { return _point_kcal[j]; }
+    int point_protein_g(size_t j) const { return _point_protein_g[j]; }
+    
+    // Memory used by the choice bit matrix, in bytes.
+    size_t bytes() const { return _taken.bytes(); }
+    
+    // The most protein of any subset within total_kcal, in
+    // O(log size()) time. total_kcal must be covered.
+    int max_protein_g(int total_kcal) const {
+        assert(covers(total_kcal));
+        int j = point_within(std::min(total_kcal, _table_kcal));
+        return (j < 0) ? 0 : _point_protein_g[j];
+    }
+    
+    // An optimal selection within total_kcal, in O(log size() + n)
+    // time, walking the choice matrix back from the cheapest budget
+    // with the most protein. total_kcal must be covered.
+    Selection selection(int total_kcal) const {
+        assert(covers(total_kcal));
+        int j = point_within(std::min(total_kcal, _table_kcal));
+        if (j < 0) {
+            return Selection();
+        }
+        std::vector<int> chosen;
+        int c = _point_kcal[j], chosen_kcal = 0;
+        for (int i = int(_kcal.size()) - 1; i >= 0; i--) {
+            if (_taken.get(i, c)) {
+                chosen.push_back(i);
+                c -= _kcal[i];
+                chosen_kcal += _kcal[i];
+            }
+        }
+        return Selection(chosen, chosen_kcal, _point_protein_g[j]);
+    }
+    
+    // An optimal set of foods within total_kcal, where foods is the
+    // vector the frontier was built from.
+    std::unique_ptr<FoodVector> max_protein(const FoodVector& foods, int total_kcal) const {
+        assert(foods.size() == _kcal.size());
+        return selection(total_kcal).to_food_vector(foods);
+    }
+};
+
+// Foods that survive reduce_foods, as columns, with the index each
+// one had in the original input.
+struct FoodReduction {
+    std::vector<int32_t> kcal;
+    std::vector<int32_t> protein_g;
+    std::vector<int> original;
+    
+    int size() const { return kcal.size(); }
+    
+    // selection, made over the reduced columns, in terms of the
+    // original indices.
+    Selection to_original(const Selection& selection) const {
+        std::vector<int> indices;
+        for (int i : selection.indices()) {
+            indices.push_back(original[i]);
+        }
+        return Selection(indices, selection.total_kcal(), selection.total_protein_g());
+    }
+};
+
+// Sizes before and after reduce_foods, reported by the solvers that
+// can run it.
+struct ReductionStats {
+    int original_n;
+    int reduced_n;
+    
+    ReductionStats() : original_n(0), reduced_n(0) { }
+};
+
+// Remove the foods, out of n whose kcal and protein are given as
+// columns, that no optimal selection within total_kcal needs: foods
+// without protein, foods over the budget, and dominated foods. Food j
+// is dominated by food i when i has at most j's kcal and at least its
+// protein (ties go to the lower index). Any selection holding j but
+// not some food dominating it does as well by swapping j for that
+// food, so j can go whenever the foods dominating it, together with
+// j, could never all fit in the budget at once. Their kcal sums are
+// accumulated in a Fenwick tree over protein ranks, in O(n log n)
+// time. The optimal protein is unchanged, though which optimal
+// selection a solver returns may differ. The survivors keep their
+// relative order.
+FoodReduction reduce_foods(const int32_t* kcal, const int32_t* protein_g, int n, int total_kcal) {
+    TRACE_SPAN("reduce_foods");
+    std::vector<int> candidates;
+    int64_t negative_kcal = 0;
+    for (int i = 0; i < n; i++) {
+        if (protein_g[i] > 0 && kcal[i] <= total_kcal) {
+            candidates.push_back(i);
+            negative_kcal += std::min(kcal[i], 0);
+        }
+    }
+    
+    // Dominators of a food come before it in this order, and are
+    // exactly the earlier foods with at least as much protein.
+    std::sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+        if (kcal[a] != kcal[b]) {
+            return kcal[a] < kcal[b];
+        }
+        if (protein_g[a] != protein_g[b]) {
+            return protein_g[a] > protein_g[b];
+        }
+        return a < b;
+    });
+    std::vector<int32_t> proteins;
+    for (int i : candidates) {
+        proteins.push_back(protein_g[i]);
+    }
+    std::sort(proteins.begin(), proteins.end(), std::greater<int32_t>());
+    proteins.erase(std::unique(proteins.begin(), proteins.end()), proteins.end());
+    
+    // tree[r] sums kcal over a range of protein ranks ending at r,
+    // 1-based, with rank 1 the most protein.
+    std::vector<int64_t> tree(proteins.size() + 1, 0);
+    std::vector<bool> keep(n, false);
+    for (int i : candidates) {
+        int rank = int(std::lower_bound(proteins.begin(), proteins.end(), protein_g[i],
+                                        std::greater<int32_t>()) - proteins.begin()) + 1;
+        int64_t dominator_kcal = 0;
+        for (int r = rank; r > 0; r -= r & -r) {
+            dominator_kcal += tree[r];
+        }
+        // Any other food taken along with j and all its dominators
+        // adds at least negative_kcal.
+        keep[i] = (dominator_kcal + kcal[i] + negative_kcal <= total_kcal);
+        for (int r = rank; r < int(tree.size()); r += r & -r) {
+            tree[r] += kcal[i];
+        }
+    }
+    
+    FoodReduction result;
+    for (int i = 0; i < n; i++) {
+        if (keep[i]) {
+            result.kcal.push_back(kcal[i]);
+            result.protein_g.push_back(protein_g[i]);
+            result.original.push_back(i);
+        }
+    }
+    return result;
+}
+
+// Run solver, a column solver like exhaustive_selection_gray, on the
+// foods that survive reduce_foods, and return its selection in terms
+// of the original indices. The sizes before and after are reported
+// through stats when it is not nullptr.
+template <typename Solver>
+Selection reduced_selection(const Solver& solver, const int32_t* kcal, const int32_t* protein_g, int n,
+                            int total_kcal, ReductionStats* stats) {
+    FoodReduction reduction = reduce_foods(kcal, protein_g, n, total_kcal);
+    if (stats) {
+        stats->original_n = n;
+        stats->reduced_n = reduction.size();
+    }
+    if (total_kcal < 0) {
+        // Not even the empty selection fits; let the solver say so.
+        return solver(kcal, protein_g, 0, total_kcal);
+    }
+    return reduction.to_original(solver(reduction.kcal.data(), reduction.protein_g.data(),
+                                        reduction.size(), total_kcal));
+}
+
+// Exhaustive search over the foods of table that survive
+// reduce_foods. The table may have 64 rows or more, as long as fewer
+// than 64 survive.
+Selection exhaustive_max_protein_reduced(const FoodTable& table, int total_kcal,
+                                         ReductionStats* stats = nullptr) {
+    return reduced_selection(exhaustive_selection_gray, table.kcal_data(), table.protein_g_data(),
+                             table.size(), total_kcal, stats);
+}
+
+// exhaustive_max_protein, after first removing the foods reduce_foods
+// proves unnecessary; each one removed halves the search. foods may
+// have 64 or more elements as long as fewer than 64 survive.
+std::unique_ptr<FoodVector> exhaustive_max_protein_reduced(const FoodVector& foods, int total_kcal,
+                                                           ReductionStats* stats = nullptr) {
+    FoodColumns columns(foods);
+    return reduced_selection(exhaustive_selection_gray, columns.kcal.data(), columns.protein_g.data(),
+                             columns.size(), total_kcal, stats).to_food_vector(foods);
+}
+
+// Meet-in-the-middle search over the foods of table that survive
+// reduce_foods, fewer than 64 of which must survive. within_memory is
+// as for meet_in_the_middle_selection.
+Selection meet_in_the_middle_max_protein_reduced(const FoodTable& table, int total_kcal,
+                                                 ReductionStats* stats = nullptr,
+                                                 bool* within_memory = nullptr) {
+    auto solver = [&](const int32_t* kcal, const int32_t* protein_g, int n, int budget) {
+        return meet_in_the_middle_selection(kcal, protein_g, n, budget, within_memory);
+    };
+    return reduced_selection(solver, table.kcal_data(), table.protein_g_data(),
+                             table.size(), total_kcal, stats);
+}
+
+// meet_in_the_middle_max_protein, after first removing the foods
+// reduce_foods proves unnecessary. Returns nullptr when the search
+// would need more than MEET_IN_THE_MIDDLE_MAX_BYTES.
+std::unique_ptr<FoodVector> meet_in_the_middle_max_protein_reduced(const FoodVector& foods, int total_kcal,
+                                                                   ReductionStats* stats = nullptr) {
+    FoodColumns columns(foods);
+    bool within_memory = true;
+    auto solver = [&](const int32_t* kcal, const int32_t* protein_g, int n, int budget) {
+        return meet_in_the_middle_selection(kcal, protein_g, n, budget, &within_memory);
+    };
+    Selection selection = reduced_selection(solver, columns.kcal.data(), columns.protein_g.data(),
+                                            columns.size(), total_kcal, stats);
+    return within_memory ? selection.to_food_vector(foods) : nullptr;
+}
+
+// Branch and bound over the foods of table that survive reduce_foods.
+Selection branch_and_bound_max_protein_reduced(const FoodTable& table, int total_kcal,
+                                               const BranchAndBoundLimits& limits = BranchAndBoundLimits(),
+                                               BranchAndBoundStats* stats = nullptr,
+                                               ReductionStats* reduction_stats = nullptr) {
+    auto solver = [&](const int32_t* kcal, const int32_t* protein_g, int n, int budget) {
+        return branch_and_bound_selection(kcal, protein_g, n, budget, limits, stats);
+    };
+    return reduced_selection(solver, table.kcal_data(), table.protein_g_data(), table.size(),
+                             total_kcal, reduction_stats);
+}
+
+// branch_and_bound_max_protein, after first removing the foods
+// reduce_foods proves unnecessary, which also tightens the bounds.
+std::unique_ptr<FoodVector> branch_and_bound_max_protein_reduced(const FoodVector& foods, int total_kcal,
+                                                                 const BranchAndBoundLimits& limits = BranchAndBoundLimits(),
+                                                                 BranchAndBoundStats* stats = nullptr,
+                                                                 ReductionStats* reduction_stats = nullptr) {
+    FoodColumns columns(foods);
+    auto solver = [&](const int32_t* kcal, const int32_t* protein_g, int n, int budget) {
+        return branch_and_bound_selection(kcal, protein_g, n, budget, limits, stats);
+    };
+    return reduced_selection(solver, columns.kcal.data(), columns.protein_g.data(), columns.size(),
+                             total_kcal, reduction_stats).to_food_vector(foods);
+}
+
+// Fully polynomial-time approximation scheme for the most protein
+// within total_kcal, over n foods whose kcal and protein are given as
+// columns. The foods are first reduced with reduce_foods. Protein is
+// then divided by a scale K = epsilon * L / m and rounded down, where
+// L is the protein of a feasible selection (the better of greedy and
+// the single richest food) and m is the most foods any selection
+// within the budget can hold. dynamic_programming_by_protein_selection
+// solves the scaled problem exactly. Rounding loses less than K per
+// chosen food, so the result has at least (1 - epsilon) times the
+// optimal protein. The scaled protein sum is at most n * m / epsilon,
+// so the time is O(n^2 m / epsilon). When K would be at most 1,
+// scaling saves nothing and the reduced foods are solved exactly with
+// dual_dynamic_programming_selection instead. The scale used is
+// reported through scale_used when it is not nullptr, and is 1 for an
+// exact solution.
+Selection fptas_selection(const int32_t* kcal, const int32_t* protein_g, int n, int total_kcal,
+                          double epsilon, double* scale_used = nullptr) {
+    TRACE_SPAN("fptas");
+    assert(epsilon > 0);
+    if (scale_used) {
+        *scale_used = 1;
+    }
+    if (total_kcal < 0) {
+        return Selection();
+    }
+    FoodReduction reduction = reduce_foods(kcal, protein_g, n, total_kcal);
+    const int m_foods = reduction.size();
+    if (m_foods == 0) {
+        return Selection();
+    }
+    
+    int lower_bound = greedy_selection(reduction.kcal.data(), reduction.protein_g.data(),
+                                       m_foods, total_kcal).total_protein_g();
+    lower_bound = std::max(lower_bound, *std::max_element(reduction.protein_g.begin(),
+                                                          reduction.protein_g.end()));
+    std::vector<int32_t> cheapest = reduction.kcal;
+    std::sort(cheapest.begin(), cheapest.end());
+    int64_t used = 0;
+    int most_foods = 0;
+    while (most_foods < m_foods && used + cheapest[most_foods] <= total_kcal) {
+        used += cheapest[most_foods++];
+    }
+    most_foods = std::max(most_foods, 1);
+    
+    const double scale = epsilon * lower_bound / most_foods;
+    if (scale <= 1) {
+        return reduction.to_original(dual_dynamic_programming_selection(
+            reduction.kcal.data(), reduction.protein_g.data(), m_foods, total_kcal));
+    }
+    if (scale_used) {
+        *scale_used = scale;
+    }
+    std::vector<int32_t> scaled(m_foods);
+    for (int i = 0; i < m_foods; i++) {
+        scaled[i] = int32_t(reduction.protein_g[i] / scale);
+    }
+    Selection approximate = dynamic_programming_by_protein_selection(reduction.kcal.data(), scaled.data(),
+                                                                     m_foods, total_kcal);
+    // Report the true totals, not the scaled ones.
+    int chosen_kcal = 0, chosen_protein = 0;
+    for (int i : approximate.indices()) {
+        chosen_kcal += reduction.kcal[i];
+        chosen_protein += reduction.protein_g[i];
+    }
+    return reduction.to_original(Selection(approximate.indices(), chosen_kcal, chosen_protein));
+}
+
+// Approximate solution over a FoodTable, within a factor (1 - epsilon)
+// of optimal.
+Selection fptas_max_protein(const FoodTable& table, int total_kcal, double epsilon,
+                            double* scale_used = nullptr) {
+    return fptas_selection(table.kcal_data(), table.protein_g_data(), table.size(), total_kcal,
+                           epsilon, scale_used);
+}
+
+// Compute a set of foods within total_kcal whose protein is at least
+// (1 - epsilon) times the optimum, in time polynomial in the number
+// of foods and 1 / epsilon. Larger epsilon trades accuracy for speed;
+// see fptas_selection.
+std::unique_ptr<FoodVector> fptas_max_protein(const FoodVector& foods, int total_kcal, double epsilon,
+                                              double* scale_used = nullptr) {
+    FoodColumns columns(foods);
+    return fptas_selection(columns.kcal.data(), columns.protein_g.data(), columns.size(), total_kcal,
+                           epsilon, scale_used).to_food_vector(foods);
+}
@@ -0,0 +1,812 @@
+///////////////////////////////////////////////////////////////////////////////
+// maxprotein_bench.cc
+//
+// Microbenchmarks for individual pieces of maxprotein.hh. Run with no
+// arguments to run every benchmark, or name the benchmarks to run,
+// e.g.
+//
+//    ./maxprotein_bench parse_mil
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "maxprotein.hh"
+#include "timer.hh"
+
+using namespace std;
+
+void print_bar() {
+    cout << string(79, '-') << endl;
+}
+
+// Collect the raw text of every numeric field that load_usda_abbrev
+// parses (kcal, protein, and grams per amount) from an ABBREV file.
+vector<string> abbrev_numeric_fields(const string& path) {
+    vector<string> result;
+    ifstream f(path);
+    for (string line; getline(f, line); ) {
+        vector<string> fields;
+        stringstream ss(line);
+        for (string field; getline(ss, field, '^'); ) {
+            fields.push_back(field);
+        }
+        if (fields.size() == ABBREV_FIELD_COUNT) {
+            result.push_back(fields[ABBREV_KCAL]);
+            result.push_back(fields[ABBREV_PROTEIN_G]);
+            result.push_back(fields[ABBREV_AMOUNT_G]);
+        }
+    }
+    return result;
+}
+
+// Fields parsed per second by the stringstream parser that
+// load_usda_abbrev used to use, and by parse_mil_range.
+void bench_parse_mil() {
+    auto fields = abbrev_numeric_fields("ABBREV.txt");
+    assert(!fields.empty());
+    
+    // Check that both parsers agree on every field before timing them.
+    for (auto& field : fields) {
+        int stream_value = 0, range_value = 0;
+        bool stream_ok = parse_mil_stream(stream_value, field),
+        range_ok = parse_mil_range(range_value, field.data(), field.data() + field.size());
+        assert(stream_ok == range_ok);
+        assert(!stream_ok || stream_value == range_value);
+    }
+    
+    const int passes = 20;
+    long checksum = 0;
+    Timer timer;
+    
+    timer.reset();
+    for (int pass = 0; pass < passes; pass++) {
+        for (auto& field : fields) {
+            int value = 0;
+            parse_mil_stream(value, field);
+            checksum += value;
+        }
+    }
+    double stream_elapsed = timer.elapsed();
+    
+    timer.reset();
+    for (int pass = 0; pass < passes; pass++) {
+        for (auto& field : fields) {
+            int value = 0;
+            parse_mil_range(value, field.data(), field.data() + field.size());
+            checksum += value;
+        }
+    }
+    double range_elapsed = timer.elapsed();
+    
+    double total = double(fields.size()) * passes;
+    print_bar();
+    cout << "parse_mil: " << fields.size() << " ABBREV fields x " << passes << " passes"
+         << " (checksum " << checksum << ")" << endl;
+    cout << "stringstream parser: " << total / stream_elapsed << " fields/second" << endl;
+    cout << "parse_mil_range:     " << total / range_elapsed << " fields/second" << endl;
+    cout << "speedup = " << stream_elapsed / range_elapsed << "x" << endl;
+}
+
+// Write a copy of the ABBREV file at source, repeated copies times,
+// to path. Returns the size of the copy in bytes.
+size_t write_replicated_file(const string& source, const string& path, int copies) {
+    ifstream in(source, ios::binary);
+    stringstream contents;
+    contents << in.rdbuf();
+    string text = contents.str();
+    ofstream out(path, ios::binary | ios::trunc);
+    for (int i = 0; i < copies; i++) {
+        out << text;
+    }
+    return text.size() * copies;
+}
+
+// True when a and b hold the same foods, field by field, in the same
+// order.
+bool same_foods(const FoodVector& a, const FoodVector& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if ((a[i]->description() != b[i]->description()) ||
+            (a[i]->amount() != b[i]->amount()) ||
+            (a[i]->amount_g() != b[i]->amount_g()) ||
+            (a[i]->kcal() != b[i]->kcal()) ||
+            (a[i]->protein_g() != b[i]->protein_g())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Throughput, in MB/s, of the getline-based load_usda_abbrev against
+// the mmap loader with each line indexer the CPU supports, on
+// ABBREV.txt and on a 100x replicated copy of it. Also reports the
+// indexing pass on its own, without building any foods.
+void bench_tokenizer() {
+    const string replicated_path = "ABBREV_x100.txt";
+    vector<pair<string, size_t>> inputs = {
+        { "ABBREV.txt", MappedFile("ABBREV.txt").size() },
+        { replicated_path, write_replicated_file("ABBREV.txt", replicated_path, 100) },
+    };
+    
+    vector<SimdIsa> isas;
+    for (auto isa : { SimdIsa::scalar, SimdIsa::sse2, SimdIsa::avx2 }) {
+        if (simd_isa_supported(isa)) {
+            isas.push_back(isa);
+        }
+    }
+    
+    Timer timer;
+    for (auto& input : inputs) {
+        double megabytes = input.second / 1e6;
+        print_bar();
+        cout << "tokenizer: " << input.first << " (" << megabytes << " MB)" << endl;
+        
+        timer.reset();
+        auto foods = load_usda_abbrev(input.first);
+        double elapsed = timer.elapsed();
+        assert(foods);
+        cout << "getline load_usda_abbrev:   " << megabytes / elapsed << " MB/s" << endl;
+        
+        for (auto isa : isas) {
+            timer.reset();
+            auto mapped = load_usda_abbrev_mmap(input.first, isa);
+            elapsed = timer.elapsed();
+            assert(mapped && mapped->size() == foods->size());
+            cout << "mmap load, " << simd_isa_name(isa) << " indexer: "
+                 << megabytes / elapsed << " MB/s" << endl;
+        }
+        
+        MappedFile file(input.first);
+        for (auto isa : isas) {
+            const char* seps[ABBREV_FIELD_COUNT];
+            long total_seps = 0;
+            timer.reset();
+            for (const char* p = file.begin(); p != file.end(); ) {
+                int count = 0;
+                const char* line_end = index_abbrev_line(isa, p, file.end(), seps, count);
+                total_seps += count;
+                p = (line_end == file.end()) ? line_end : line_end + 1;
+            }
+            elapsed = timer.elapsed();
+            cout << "index only, " << simd_isa_name(isa) << ": "
+                 << megabytes / elapsed << " MB/s (" << total_seps << " separators)" << endl;
+        }
+    }
+    std::remove(replicated_path.c_str());
+}
+
+// Throughput, in MB/s, of load_usda_abbrev_parallel on a 100x
+// replicated copy of ABBREV.txt with 1, 2, 4, ... threads up to one
+// per hardware core, and the speedup over one thread. Each load is
+// checked against the single-threaded mmap loader.
+void bench_parallel_load() {
+    const string replicated_path = "ABBREV_x100.txt";
+    double megabytes = write_replicated_file("ABBREV.txt", replicated_path, 100) / 1e6;
+    unsigned cores = max(1u, thread::hardware_concurrency());
+    vector<unsigned> thread_counts;
+    for (unsigned threads = 1; threads < cores; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(cores);
+    
+    print_bar();
+    cout << "parallel_load: " << replicated_path << " (" << megabytes << " MB), "
+         << cores << " hardware threads" << endl;
+    auto expected = load_usda_abbrev_mmap(replicated_path);
+    assert(expected);
+    
+    Timer timer;
+    double one_thread = 0;
+    for (unsigned threads : thread_counts) {
+        double best = -1;
+        bool same = true;
+        for (int run = 0; run < 3; run++) {
+            timer.reset();
+            auto foods = load_usda_abbrev_parallel(replicated_path, threads);
+            double elapsed = timer.elapsed();
+            same = same && foods && same_foods(*expected, *foods);
+            if (best < 0 || elapsed < best) {
+                best = elapsed;
+            }
+        }
+        if (threads == 1) {
+            one_thread = best;
+        }
+        cout << "threads = " << threads << ": " << megabytes / best << " MB/s, speedup "
+             << one_thread / best << "x" << (same ? "" : ", DIFFERENT FOODS") << endl;
+        assert(same);
+    }
+    std::remove(replicated_path.c_str());
+}
+
+// Time to get the first n foods of ABBREV.txt in a kcal range, by
+// loading everything and then calling filter_food_vector, versus
+// streaming with the filter pushed down into the loader.
+void bench_stream() {
+    const int repetitions = 20;
+    Timer timer;
+    print_bar();
+    cout << "stream: first n foods with 1 < kcal < 2000, best of " << repetitions << endl;
+    for (int n : { 10, 100, 1000, 8000 }) {
+        double full = 1e9, streamed = 1e9;
+        for (int r = 0; r < repetitions; r++) {
+            timer.reset();
+            auto all_foods = load_usda_abbrev_mmap("ABBREV.txt");
+            auto filtered = filter_food_vector(*all_foods, 1, 2000, n);
+            full = min(full, timer.elapsed());
+            
+            timer.reset();
+            auto pushed = load_filtered_usda_abbrev("ABBREV.txt", FoodFilter(1, 2000, n));
+            streamed = min(streamed, timer.elapsed());
+            assert(pushed->size() == filtered->size());
+        }
+        cout << "n = " << n << ": load + filter = " << full
+             << " s, streaming = " << streamed << " s" << endl;
+    }
+}
+
+// Solver time on FoodVector, which chases a shared_ptr for every
+// kcal and protein access, against the same solver on a FoodTable.
+void bench_food_table() {
+    auto all_foods = load_usda_abbrev_mmap("ABBREV.txt");
+    assert(all_foods);
+    auto filtered = filter_food_vector(*all_foods, 0, INT_MAX, all_foods->size());
+    FoodTable table(*filtered);
+    const int total_kcal = 2500;
+    Timer timer;
+    
+    print_bar();
+    cout << "food_table: greedy, n = " << filtered->size() << endl;
+    timer.reset();
+    auto greedy_vector = greedy_max_protein(*filtered, total_kcal);
+    double vector_elapsed = timer.elapsed();
+    timer.reset();
+    auto greedy_table = greedy_max_protein(table, total_kcal);
+    double table_elapsed = timer.elapsed();
+    assert(greedy_vector->size() == greedy_table.size());
+    cout << "FoodVector: " << vector_elapsed << " s, FoodTable: " << table_elapsed << " s" << endl;
+    
+    const int n = 20;
+    auto small = filter_food_vector(*all_foods, 0, INT_MAX, n);
+    FoodTable small_table(*small);
+    cout << "food_table: exhaustive, n = " << n << endl;
+    timer.reset();
+    auto exhaustive_vector = exhaustive_max_protein(*small, total_kcal);
+    vector_elapsed = timer.elapsed();
+    timer.reset();
+    auto exhaustive_table = exhaustive_max_protein(small_table, total_kcal);
+    table_elapsed = timer.elapsed();
+    assert(exhaustive_vector->size() == exhaustive_table.size());
+    cout << "FoodVector: " << vector_elapsed << " s, FoodTable: " << table_elapsed << " s" << endl;
+}
+
+// Fill kcal and protein columns with n synthetic foods, with values
+// in the same ranges as ABBREV.txt, from a fixed seed.
+void synthetic_columns(int n, vector<int32_t>& kcal, vector<int32_t>& protein_g) {
+    mt19937 rng(335);
+    uniform_int_distribution<int> kcal_dist(1, 900), protein_dist(0, 90);
+    kcal.resize(n);
+    protein_g.resize(n);
+    for (int i = 0; i < n; i++) {
+        kcal[i] = kcal_dist(rng);
+        protein_g[i] = protein_dist(rng);
+    }
+}
+
+// Scaling of the O(n log n) greedy engine on synthetic inputs up to
+// 10 million foods, with the original O(n^2) loop alongside while it
+// still finishes quickly.
+void bench_greedy_scaling() {
+    const int total_kcal = 2500;
+    const int quadratic_limit = 20000;
+    Timer timer;
+    print_bar();
+    cout << "greedy_scaling: synthetic foods, total_kcal = " << total_kcal << endl;
+    for (int n : { 1000, 10000, 20000, 100000, 1000000, 10000000 }) {
+        vector<int32_t> kcal, protein_g;
+        synthetic_columns(n, kcal, protein_g);
+        
+        timer.reset();
+        auto fast = greedy_selection(kcal.data(), protein_g.data(), n, total_kcal);
+        double fast_elapsed = timer.elapsed();
+        cout << "n = " << n << ": sorted = " << fast_elapsed << " s";
+        
+        if (n <= quadratic_limit) {
+            timer.reset();
+            auto reference = greedy_selection_quadratic(kcal.data(), protein_g.data(), n, total_kcal);
+            double reference_elapsed = timer.elapsed();
+            assert(fast == reference);
+            cout << ", quadratic = " << reference_elapsed << " s";
+        }
+        cout << endl;
+    }
+}
+
+// Gray-code exhaustive search on the first n ABBREV foods, up to
+// n = 30, with the original O(n) per subset search alongside while it
+// still finishes quickly.
+void bench_exhaustive_gray() {
+    auto all_foods = load_usda_abbrev_mmap("ABBREV.txt");
+    assert(all_foods);
+    const int total_kcal = 2000;
+    const int plain_limit = 22;
+    Timer timer;
+    print_bar();
+    cout << "exhaustive_gray: first n ABBREV foods, total_kcal = " << total_kcal << endl;
+    for (int n = 16; n <= 30; n += 2) {
+        auto foods = filter_food_vector(*all_foods, 0, INT_MAX, n);
+        FoodTable table(*foods);
+        
+        timer.reset();
+        auto gray = exhaustive_max_protein_gray(table, total_kcal);
+        double gray_elapsed = timer.elapsed();
+        cout << "n = " << n << ": gray = " << gray_elapsed << " s";
+        
+        if (n <= plain_limit) {
+            timer.reset();
+            auto plain = exhaustive_max_protein(table, total_kcal);
+            double plain_elapsed = timer.elapsed();
+            assert(gray == plain);
+            cout << ", plain = " << plain_elapsed << " s";
+        }
+        cout << " (protein = " << gray.total_protein_g() << " g)" << endl;
+    }
+}
+
+// Parallel exhaustive search on the first 28 ABBREV foods, with 1, 2,
+// 4, ... threads up to the number of hardware cores, reporting the
+// speedup over one thread and the speedup per core.
+void bench_exhaustive_parallel() {
+    auto all_foods = load_usda_abbrev_mmap("ABBREV.txt");
+    assert(all_foods);
+    const int n = 28, total_kcal = 2000;
+    FoodTable table(*filter_food_vector(*all_foods, 0, INT_MAX, n));
+    unsigned cores = default_thread_count(0);
+    
+    vector<unsigned> thread_counts;
+    for (unsigned threads = 1; threads < cores; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(cores);
+    
+    Timer timer;
+    print_bar();
+    cout << "exhaustive_parallel: n = " << n << ", total_kcal = " << total_kcal
+         << ", " << cores << " hardware threads" << endl;
+    double single = 0;
+    Selection reference;
+    for (unsigned threads : thread_counts) {
+        timer.reset();
+        auto selection = exhaustive_max_protein_parallel(table, total_kcal, threads);
+        double elapsed = timer.elapsed();
+        if (threads == 1) {
+            single = elapsed;
+            reference = selection;
+        }
+        assert(selection == reference);
+        double speedup = single / elapsed;
+        cout << "threads = " << threads << ": " << elapsed << " s, speedup = " << speedup
+             << "x, per core = " << speedup / threads << endl;
+    }
+}
+
+// Throughput of the exhaustive search kernels, in subsets per second,
+// for every instruction set the CPU supports, on the first 28 ABBREV
+// foods. "scalar" is the Gray-code walk.
+void bench_subset_kernel() {
+    auto all_foods = load_usda_abbrev_mmap("ABBREV.txt");
+    assert(all_foods);
+    const int n = 28, total_kcal = 2000;
+    FoodTable table(*filter_food_vector(*all_foods, 0, INT_MAX, n));
+    double subsets = double(uint64_t(1) << n);
+    
+    Timer timer;
+    print_bar();
+    cout << "subset_kernel: n = " << n << ", total_kcal = " << total_kcal << endl;
+    Selection reference = exhaustive_max_protein_gray(table, total_kcal);
+    for (auto isa : { SimdIsa::scalar, SimdIsa::avx2, SimdIsa::avx512 }) {
+        if (!simd_isa_supported(isa)) {
+            cout << simd_isa_name(isa) << ": not supported" << endl;
+            continue;
+        }
+        timer.reset();
+        auto selection = exhaustive_max_protein_simd(table, total_kcal, isa);
+        double elapsed = timer.elapsed();
+        assert(selection == reference);
+        cout << simd_isa_name(isa) << ": " << elapsed << " s, "
+             << subsets / elapsed << " subsets/second" << endl;
+    }
+}
+
+// Branch and bound on the first n ABBREV foods, far past what
+// exhaustive search can do, reporting its search statistics.
+void bench_branch_and_bound() {
+    auto all_foods = load_usda_abbrev_mmap("ABBREV.txt");
+    assert(all_foods);
+    print_bar();
+    cout << "branch_and_bound: first n ABBREV foods" << endl;
+    for (int n : { 100, 1000, 8490 }) {
+        FoodTable table(*filter_food_vector(*all_foods, 0, INT_MAX, n));
+        for (int total_kcal : { 1000, 2000, 2500 }) {
+            BranchAndBoundStats stats;
+            auto selection = branch_and_bound_max_protein(table, total_kcal,
+                                                          BranchAndBoundLimits(0, 10.0), &stats);
+            cout << "n = " << table.size() << ", total_kcal = " << total_kcal
+                 << ": protein = " << selection.total_protein_g()
+                 << " (greedy " << greedy_max_protein(table, total_kcal).total_protein_g() << ")"
+                 << ", upper bound = " << stats.upper_bound
+                 << (stats.optimal ? " optimal" : " NOT proven optimal")
+                 << ", nodes = " << stats.nodes << ", prunes = " << stats.prunes
+                 << ", " << stats.seconds << " s, best found at " << stats.seconds_to_best << " s"
+                 << endl;
+        }
+    }
+}
+
+// Dynamic programming over the calorie budget on the whole ABBREV
+// database.
+void bench_dynamic_programming() {
+    auto all_foods = load_usda_abbrev_mmap("ABBREV.txt");
+    assert(all_foods);
+    FoodTable table(*filter_food_vector(*all_foods, 0, INT_MAX, all_foods->size()));
+    Timer timer;
+    print_bar();
+    cout << "dynamic_programming: n = " << table.size() << endl;
+    for (int total_kcal : { 1000, 2000, 2500 }) {
+        timer.reset();
+        auto selection = dynamic_programming_max_protein(table, total_kcal);
+        double elapsed = timer.elapsed();
+        cout << "total_kcal = " << total_kcal << ": protein = " << selection.total_protein_g()
+             << ", " << elapsed << " s, choice matrix = "
+             << BitMatrix(table.size(), total_kcal + 1).bytes() / 1e6 << " MB" << endl;
+    }
+}
+
+// Run work in a forked child process and return the child's peak
+// resident set size in MB, so that each measurement starts from a
+// fresh process. elapsed is set to the time work took, or to -1 if
+// the child did not report it. Returns -1 when the child cannot be
+// started or does not exit cleanly.
+double run_for_peak_rss(const function<void()>& work, double& elapsed) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        return -1;
+    }
+    pid_t child = fork();
+    if (child < 0) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return -1;
+    }
+    if (child == 0) {
+        close(pipe_fds[0]);
+        Timer timer;
+        work();
+        double seconds = timer.elapsed();
+        ssize_t written = write(pipe_fds[1], &seconds, sizeof(seconds));
+        _exit(written == sizeof(seconds) ? 0 : 1);
+    }
+    // Close our copy of the write end first, so that the read sees end
+    // of file rather than blocking if the child dies without writing.
+    close(pipe_fds[1]);
+    double seconds;
+    size_t got = 0;
+    while (got < sizeof(seconds)) {
+        ssize_t n = read(pipe_fds[0], reinterpret_cast<char*>(&seconds) + got, sizeof(seconds) - got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+    }
+    close(pipe_fds[0]);
+    elapsed = (got == sizeof(seconds)) ? seconds : -1;
+    int status;
+    struct rusage usage;
+    if (wait4(child, &status, 0, &usage) != child ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return -1;
+    }
+    return usage.ru_maxrss / 1024.0;
+}
+
+// Cold-start load time of ABBREV.txt and a 100x replicated copy of
+// it: the text loaders against opening a valid snapshot, once
+// materialized as a FoodVector and once with its columns used in
+// place. Each load runs in a fresh process, so nothing is warm but
+// the page cache; the best of three runs is reported.
+void bench_snapshot() {
+    const string replicated_path = "ABBREV_x100.txt";
+    vector<pair<string, size_t>> inputs = {
+        { "ABBREV.txt", MappedFile("ABBREV.txt").size() },
+        { replicated_path, write_replicated_file("ABBREV.txt", replicated_path, 100) },
+    };
+    const string snapshot_path = "maxprotein_bench.snapshot";
+    for (auto& input : inputs) {
+        const string path = input.first;
+        std::remove(snapshot_path.c_str());
+        auto foods = load_usda_abbrev_cached(path, snapshot_path);
+        assert(foods && FoodSnapshot(snapshot_path, path).ok());
+        print_bar();
+        cout << "snapshot: " << path << " (" << input.second / 1e6 << " MB text, "
+             << MappedFile(snapshot_path).size() / 1e6 << " MB snapshot, "
+             << foods->size() << " foods)" << endl;
+        
+        vector<pair<string, function<void()>>> loaders = {
+            { "load_usda_abbrev", [&]() { load_usda_abbrev(path); } },
+            { "load_usda_abbrev_mmap", [&]() { load_usda_abbrev_mmap(path); } },
+            { "load_usda_abbrev_cached", [&]() { load_usda_abbrev_cached(path, snapshot_path); } },
+            { "load_usda_abbrev_snapshot", [&]() { load_usda_abbrev_snapshot(path, snapshot_path); } },
+        };
+        double text_seconds = 0;
+        for (auto& loader : loaders) {
+            double best = -1;
+            for (int run = 0; run < 3; run++) {
+                double elapsed;
+                run_for_peak_rss(loader.second, elapsed);
+                if (elapsed >= 0 && (best < 0 || elapsed < best)) {
+                    best = elapsed;
+                }
+            }
+            if (text_seconds == 0) {
+                text_seconds = best;
+            }
+            cout << loader.first << ": " << best << " s, speedup " << text_seconds / best << "x" << endl;
+        }
+    }
+    std::remove(snapshot_path.c_str());
+    std::remove(replicated_path.c_str());
+}
+
+// Time and peak RSS of the two dynamic programming modes, the choice
+// matrix and the linear-memory divide and conquer, on ABBREV.txt and
+// on synthetic catalogs with large budgets.
+void bench_dynamic_programming_memory() {
+    print_bar();
+    cout << "dynamic_programming_memory: peak RSS per solver run, in a fresh process" << endl;
+    
+    struct Case {
+        string name;
+        int n;
+        int total_kcal;
+    };
+    vector<Case> cases = {
+        { "ABBREV.txt", 0, 2500 },
+        { "synthetic", 100000, 10000 },
+        { "synthetic", 200000, 20000 },
+    };
+    for (auto& c : cases) {
+        vector<int32_t> kcal, protein_g;
+        if (c.n == 0) {
+            auto all_foods = load_usda_abbrev_mmap("ABBREV.txt");
+            assert(all_foods);
+            FoodColumns columns(*all_foods);
+            kcal = columns.kcal;
+            protein_g = columns.protein_g;
+        } else {
+            synthetic_columns(c.n, kcal, protein_g);
+        }
+        double baseline_elapsed, matrix_elapsed, linear_elapsed;
+        double baseline = run_for_peak_rss([]() { }, baseline_elapsed);
+        double matrix = run_for_peak_rss([&]() {
+            dynamic_programming_selection(kcal.data(), protein_g.data(), kcal.size(), c.total_kcal);
+        }, matrix_elapsed);
+        double linear = run_for_peak_rss([&]() {
+            dynamic_programming_linear_selection(kcal.data(), protein_g.data(), kcal.size(), c.total_kcal);
+        }, linear_elapsed);
+        cout << c.name << " n = " << kcal.size() << ", total_kcal = " << c.total_kcal
+             << " (process baseline " << baseline << " MB)" << endl;
+        cout << "  choice matrix: " << matrix_elapsed << " s, peak RSS " << matrix << " MB" << endl;
+        cout << "  linear memory: " << linear_elapsed << " s, peak RSS " << linear << " MB" << endl;
+    }
+}
+
+// Kcal-indexed against protein-indexed dynamic programming on
+// synthetic catalogs as the budget grows past the protein sum, with
+// the table dual_dynamic_programming_selection picks.
+void bench_dual_dynamic_programming() {
+    print_bar();
+    cout << "dual_dynamic_programming: kcal-indexed vs protein-indexed tables" << endl;
+    vector<int32_t> kcal, protein_g;
+    synthetic_columns(2000, kcal, protein_g);
+    int64_t protein_sum = 0;
+    for (int32_t p : protein_g) {
+        protein_sum += p;
+    }
+    cout << "n = " << kcal.size() << ", protein sum = " << protein_sum << endl;
+    Timer timer;
+    for (int total_kcal : { 2500, 25000, 250000, 1000000 }) {
+        timer.reset();
+        auto by_kcal = dynamic_programming_selection(kcal.data(), protein_g.data(), kcal.size(), total_kcal);
+        double kcal_elapsed = timer.elapsed();
+        timer.reset();
+        auto by_protein = dynamic_programming_by_protein_selection(kcal.data(), protein_g.data(), kcal.size(),
+                                                                   total_kcal);
+        double protein_elapsed = timer.elapsed();
+        DpIndex index;
+        dual_dynamic_programming_selection(kcal.data(), protein_g.data(), kcal.size(), total_kcal, &index);
+        cout << "total_kcal = " << total_kcal << ": protein = " << by_kcal.total_protein_g()
+             << (by_kcal.total_protein_g() == by_protein.total_protein_g() ? "" : " (MISMATCH)")
+             << ", kcal table " << kcal_elapsed << " s, protein table " << protein_elapsed
+             << " s, dual picks " << dp_index_name(index) << endl;
+    }
+}
+
+// Building a ProteinFrontier once against rerunning dynamic
+// programming for each of many budget queries on ABBREV.txt.
+void bench_protein_frontier() {
+    auto all_foods = load_usda_abbrev_mmap("ABBREV.txt");
+    assert(all_foods);
+    FoodTable table(*filter_food_vector(*all_foods, 0, INT_MAX, all_foods->size()));
+    const int max_kcal = 2500, queries = 10000;
+    print_bar();
+    cout << "protein_frontier: n = " << table.size() << ", max_kcal = " << max_kcal << endl;
+    
+    Timer timer;
+    ProteinFrontier frontier(table, max_kcal);
+    double build = timer.elapsed();
+    cout << "build: " << build << " s, " << frontier.size() << " points, choice matrix = "
+         << frontier.bytes() / 1e6 << " MB" << endl;
+    
+    mt19937 random(335);
+    uniform_int_distribution<int> budget(0, max_kcal);
+    long checksum = 0;
+    timer.reset();
+    for (int q = 0; q < queries; q++) {
+        checksum += frontier.max_protein_g(budget(random));
+    }
+    double lookups = timer.elapsed();
+    timer.reset();
+    for (int q = 0; q < queries; q++) {
+        checksum += frontier.selection(budget(random)).size();
+    }
+    double selections = timer.elapsed();
+    timer.reset();
+    const int dp_queries = 20;
+    for (int q = 0; q < dp_queries; q++) {
+        checksum += dynamic_programming_max_protein(table, budget(random)).total_protein_g();
+    }
+    double dp = timer.elapsed();
+    cout << "max_protein_g: " << lookups / queries * 1e9 << " ns/query" << endl;
+    cout << "selection: " << selections / queries * 1e6 << " us/query" << endl;
+    cout << "dynamic_programming per query: " << dp / dp_queries * 1e3 << " ms/query"
+         << " (checksum " << checksum << ")" << endl;
+}
+
+// How far reduce_foods shrinks ABBREV.txt and synthetic catalogs,
+// and what that does to branch and bound and to exhaustive search.
+void bench_reduction() {
+    auto all_foods = load_usda_abbrev_mmap("ABBREV.txt");
+    assert(all_foods);
+    FoodTable table(*filter_food_vector(*all_foods, 0, INT_MAX, all_foods->size()));
+    Timer timer;
+    print_bar();
+    cout << "reduction: ABBREV.txt n = " << table.size() << endl;
+    for (int total_kcal : { 100, 1000, 2000, 2500 }) {
+        timer.reset();
+        FoodReduction reduction = reduce_foods(table.kcal_data(), table.protein_g_data(), table.size(), total_kcal);
+        double reduce = timer.elapsed();
+        BranchAndBoundLimits limits(0, 10);
+        BranchAndBoundStats plain_stats, reduced_stats;
+        timer.reset();
+        auto plain = branch_and_bound_max_protein(table, total_kcal, limits, &plain_stats);
+        double plain_elapsed = timer.elapsed();
+        timer.reset();
+        auto reduced = branch_and_bound_max_protein_reduced(table, total_kcal, limits, &reduced_stats);
+        double reduced_elapsed = timer.elapsed();
+        cout << "total_kcal = " << total_kcal << ": reduced n = " << reduction.size()
+             << " in " << reduce << " s; branch and bound " << plain_elapsed << " s (" << plain_stats.nodes
+             << " nodes, protein " << plain.total_protein_g() << ") vs reduced " << reduced_elapsed << " s ("
+             << reduced_stats.nodes << " nodes, protein " << reduced.total_protein_g() << ")" << endl;
+    }
+    
+    // Catalogs with many near-duplicates, as in ABBREV, where
+    // exhaustive search only becomes possible after reducing.
+    cout << "exhaustive on 60 foods drawn from 8 distinct ones, total_kcal = 1000" << endl;
+    vector<int32_t> kcal, protein_g;
+    synthetic_columns(8, kcal, protein_g);
+    FoodTable duplicates;
+    for (int i = 0; i < 60; i++) {
+        duplicates.push_back("", "", 100, kcal[i % 8], protein_g[i % 8]);
+    }
+    ReductionStats stats;
+    timer.reset();
+    auto selection = exhaustive_max_protein_reduced(duplicates, 1000, &stats);
+    cout << "reduced n = " << stats.reduced_n << ", protein = " << selection.total_protein_g()
+         << ", " << timer.elapsed() << " s" << endl;
+}
+
+// Quality and time of the FPTAS across epsilon, on ABBREV.txt and on
+// a synthetic catalog with large protein values, printed as a curve
+// with one bar of '#' per percent of the optimum.
+void bench_fptas() {
+    auto all_foods = load_usda_abbrev_mmap("ABBREV.txt");
+    assert(all_foods);
+    FoodTable abbrev(*filter_food_vector(*all_foods, 0, INT_MAX, all_foods->size()));
+    FoodTable synthetic;
+    vector<int32_t> kcal, protein_g;
+    synthetic_columns(2000, kcal, protein_g);
+    for (size_t i = 0; i < kcal.size(); i++) {
+        synthetic.push_back("", "", 100, kcal[i], protein_g[i] * 1000 + int(i % 997));
+    }
+    
+    Timer timer;
+    for (auto& data : vector<pair<string, const FoodTable*>>{ { "ABBREV.txt", &abbrev },
+                                                              { "synthetic", &synthetic } }) {
+        const FoodTable& table = *data.second;
+        const int total_kcal = 2000;
+        timer.reset();
+        int optimal = dynamic_programming_max_protein(table, total_kcal).total_protein_g();
+        double exact = timer.elapsed();
+        print_bar();
+        cout << "fptas: " << data.first << " n = " << table.size() << ", total_kcal = " << total_kcal
+             << ", optimum " << optimal << " by dynamic programming in " << exact << " s" << endl;
+        cout << "epsilon,scale,protein,ratio,seconds" << endl;
+        for (double epsilon : { 0.001, 0.01, 0.05, 0.1, 0.2, 0.3, 0.5, 0.75, 0.9 }) {
+            double scale;
+            timer.reset();
+            auto selection = fptas_max_protein(table, total_kcal, epsilon, &scale);
+            double elapsed = timer.elapsed();
+            double ratio = double(selection.total_protein_g()) / optimal;
+            cout << epsilon << "," << scale << "," << selection.total_protein_g() << "," << ratio
+                 << "," << elapsed << "  " << string(std::max(0, int((ratio - 0.5) * 100)), '#') << endl;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    
+    vector<pair<string, function<void()>>> benchmarks = {
+        { "parse_mil", bench_parse_mil },
+        { "tokenizer", bench_tokenizer },
+        { "parallel_load", bench_parallel_load },
+        { "stream", bench_stream },
+        { "snapshot", bench_snapshot },
+        { "food_table", bench_food_table },
+        { "greedy_scaling", bench_greedy_scaling },
+        { "exhaustive_gray", bench_exhaustive_gray },
+        { "exhaustive_parallel", bench_exhaustive_parallel },
+        { "subset_kernel", bench_subset_kernel },
+        { "branch_and_bound", bench_branch_and_bound },
+        { "dynamic_programming", bench_dynamic_programming },
+        { "dynamic_programming_memory", bench_dynamic_programming_memory },
+        { "dual_dynamic_programming", bench_dual_dynamic_programming },
+        { "protein_frontier", bench_protein_frontier },
+        { "reduction", bench_reduction },
+        { "fptas", bench_fptas },
+    };
+    
+    for (auto& benchmark : benchmarks) {
+        bool selected = (argc == 1);
+        for (int i = 1; i < argc; i++) {
+            selected = selected || (benchmark.first == argv[i]);
+        }
+        if (selected) {
+            benchmark.second();
+        }
+    }
+    print_bar();
+    
+    return 0;
+}
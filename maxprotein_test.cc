@@ -6,12 +6,34 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <fstream>
 #include <sstream>
 
+#include "alloc_tracker.hh"
 #include "maxprotein.hh"
 #include "rubrictest.hh"
 
+// True when a and b hold the same foods, field by field, in the same
+// order.
+bool same_foods(const FoodVector& a, const FoodVector& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if ((a[i]->description() != b[i]->description()) ||
+	(a[i]->amount() != b[i]->amount()) ||
+	(a[i]->amount_g() != b[i]->amount_g()) ||
+	(a[i]->kcal() != b[i]->kcal()) ||
+	(a[i]->protein_g() != b[i]->protein_g())) {
+      return false;
+    }
+  }
+  return true;
+}
+
 int main() {
   Rubric rubric;
 
@@ -30,6 +52,145 @@ int main() {
 		     TEST_EQUAL("size", 8490, all_foods->size());
 		   });
   
+  rubric.criterion("load_usda_abbrev_mmap", 2,
+		   [&]() {
+		     auto mapped = load_usda_abbrev_mmap("ABBREV.txt");
+		     TEST_TRUE("non-null", mapped);
+		     TEST_TRUE("same foods", same_foods(*all_foods, *mapped));
+		     TEST_FALSE("missing file", load_usda_abbrev_mmap("no-such-file.txt"));
+		   });
+  
+  rubric.criterion("vectorized ABBREV tokenizer", 2,
+		   [&]() {
+		     for (auto isa : {SimdIsa::scalar, SimdIsa::sse2, SimdIsa::avx2}) {
+		       if (!simd_isa_supported(isa)) {
+			 continue;
+		       }
+		       auto mapped = load_usda_abbrev_mmap("ABBREV.txt", isa);
+		       TEST_TRUE("non-null", mapped);
+		       TEST_TRUE(std::string("same foods with ") + simd_isa_name(isa),
+				 same_foods(*all_foods, *mapped));
+
+		       std::string line = "~01001~^~BUTTER,WITH SALT~^15.87^717^0.85";
+		       for (int i = 5; i < 48; i++) {
+			 line += "^0.0";
+		       }
+		       line += "^5.0^~1 pat~^14.2^~1 tbsp~^0\r";
+		       FoodVector foods;
+		       std::string buffer = line + "\n" + line;
+		       TEST_TRUE("no trailing newline",
+				 parse_abbrev_buffer(buffer.data(), buffer.data() + buffer.size(), foods, isa));
+		       TEST_EQUAL("two foods", 2, foods.size());
+		       TEST_EQUAL("kcal", 717, foods[1]->kcal());
+		       TEST_EQUAL("amount", "1 pat", foods[1]->amount());
+		       buffer = line + "^x\n";
+		       TEST_FALSE("54 fields",
+				  parse_abbrev_buffer(buffer.data(), buffer.data() + buffer.size(), foods, isa));
+		       buffer = line + "\n\n" + line;
+		       TEST_FALSE("empty line",
+				  parse_abbrev_buffer(buffer.data(), buffer.data() + buffer.size(), foods, isa));
+		       buffer = line + "^\n";
+		       TEST_TRUE("trailing separator does not start a field",
+				 parse_abbrev_buffer(buffer.data(), buffer.data() + buffer.size(), foods, isa));
+		     }
+		   });
+  
+  rubric.criterion("load_usda_abbrev_parallel", 2,
+		   [&]() {
+		     for (unsigned threads : {1, 2, 3, 8}) {
+		       auto parallel = load_usda_abbrev_parallel("ABBREV.txt", threads);
+		       TEST_TRUE("non-null", parallel);
+		       TEST_TRUE("same foods in file order", same_foods(*all_foods, *parallel));
+		     }
+		     TEST_FALSE("missing file", load_usda_abbrev_parallel("no-such-file.txt"));
+		   });
+  
+  rubric.criterion("food snapshot", 2,
+		   [&]() {
+		     const std::string snapshot_path = "maxprotein_test.snapshot";
+		     std::remove(snapshot_path.c_str());
+		     TEST_FALSE("missing snapshot", FoodSnapshot(snapshot_path, "ABBREV.txt").ok());
+
+		     auto built = load_usda_abbrev_cached("ABBREV.txt", snapshot_path);
+		     TEST_TRUE("non-null", built);
+		     TEST_TRUE("same foods", same_foods(*all_foods, *built));
+
+		     FoodSnapshot snapshot(snapshot_path, "ABBREV.txt");
+		     TEST_TRUE("snapshot written", snapshot.ok());
+		     TEST_EQUAL("size", all_foods->size(), snapshot.size());
+		     TEST_TRUE("same foods", same_foods(*all_foods, *snapshot.to_food_vector()));
+		     TEST_TRUE("same foods", same_foods(*all_foods, *snapshot.to_food_table().to_food_vector()));
+
+		     auto cached = load_usda_abbrev_cached("ABBREV.txt", snapshot_path);
+		     TEST_TRUE("same foods", same_foods(*all_foods, *cached));
+
+		     TEST_FALSE("stale snapshot", FoodSnapshot(snapshot_path, "maxprotein.hh").ok());
+
+		     // A damaged payload and offset table is detected, and the
+		     // snapshot rebuilt from the text file.
+		     const size_t offsets_at = sizeof(FoodSnapshotHeader) + 3 * all_foods->size() * sizeof(int32_t);
+		     auto overwrite = [&](size_t at, const void* bytes, size_t count) {
+		       std::fstream f(snapshot_path, std::ios::in | std::ios::out | std::ios::binary);
+		       f.seekp(at);
+		       f.write(static_cast<const char*>(bytes), count);
+		     };
+		     const uint32_t bad_offset = 0xfffffff0;
+		     overwrite(sizeof(FoodSnapshotHeader) + 100, "\x7f", 1);
+		     overwrite(offsets_at + 5 * sizeof(uint32_t), &bad_offset, sizeof(bad_offset));
+		     TEST_FALSE("corrupt snapshot", FoodSnapshot(snapshot_path, "ABBREV.txt").ok());
+		     auto recovered = load_usda_abbrev_cached("ABBREV.txt", snapshot_path);
+		     TEST_TRUE("corrupt snapshot loads", recovered);
+		     TEST_TRUE("same foods after corruption", same_foods(*all_foods, *recovered));
+		     TEST_TRUE("corrupt snapshot rewritten", FoodSnapshot(snapshot_path, "ABBREV.txt").ok());
+
+		     // An offset out of bounds is caught even when the checksum
+		     // matches.
+		     overwrite(offsets_at + 5 * sizeof(uint32_t), &bad_offset, sizeof(bad_offset));
+		     {
+		       MappedFile file(snapshot_path);
+		       FoodSnapshotHeader header;
+		       std::memcpy(&header, file.begin(), sizeof(header));
+		       header.checksum = snapshot_checksum(file.begin() + sizeof(header), file.end());
+		       overwrite(0, &header, sizeof(header));
+		     }
+		     TEST_FALSE("offset out of bounds", FoodSnapshot(snapshot_path, "ABBREV.txt").ok());
+		     TEST_TRUE("same foods after bad offset",
+			       same_foods(*all_foods, *load_usda_abbrev_cached("ABBREV.txt", snapshot_path)));
+		     std::remove(snapshot_path.c_str());
+
+		     auto mapped = load_usda_abbrev_snapshot("ABBREV.txt", snapshot_path);
+		     TEST_TRUE("snapshot rebuilt", mapped && mapped->ok());
+		     TEST_EQUAL("size", all_foods->size(), mapped->size());
+		     FoodTable table(*all_foods);
+		     TEST_TRUE("columns in place", std::equal(table.kcal_data(), table.kcal_data() + table.size(),
+							      mapped->kcal_data()));
+		     TEST_TRUE("columns in place", std::equal(table.protein_g_data(), table.protein_g_data() + table.size(),
+							      mapped->protein_g_data()));
+		     TEST_EQUAL("strings in place", (*all_foods)[17]->description(), mapped->description(17));
+		     TEST_FALSE("missing source", load_usda_abbrev_snapshot("no-such-file.txt", snapshot_path));
+
+
+		     std::remove(snapshot_path.c_str());
+		   });
+  
+  rubric.criterion("parse_mil_range", 2,
+		   [&]() {
+		     std::vector<std::string> fields = {
+		       "0", "717", "0.85", "81.11", "2.5", "3.49", "0.5", "-2.5", "+7",
+		       "12.", ".5", "1e3", " 42", "12abc", "", "abc", "-", ".",
+		       "1234567890.123456789", "0.49999999999999999",
+		     };
+		     for (auto& field : fields) {
+		       int stream_value = -1, range_value = -1;
+		       bool stream_ok = parse_mil_stream(stream_value, field),
+			 range_ok = parse_mil_range(range_value, field.data(), field.data() + field.size());
+		       TEST_EQUAL("parse success for \"" + field + "\"", stream_ok, range_ok);
+		       if (stream_ok) {
+			 TEST_EQUAL("rounding of \"" + field + "\"", stream_value, range_value);
+		       }
+		     }
+		   });
+  
   rubric.criterion("filter_food_vector", 2,
 		   [&]() {
 		     auto three = filter_food_vector(*all_foods, 1, 2000, 3),
@@ -45,6 +206,25 @@ int main() {
 		     }
 		   });
 
+  rubric.criterion("streaming loader with filter pushdown", 2,
+		   [&]() {
+		     for (int n : {0, 1, 10, 100}) {
+		       auto expected = filter_food_vector(*all_foods, 1, 2000, n);
+		       auto streamed = load_filtered_usda_abbrev("ABBREV.txt", FoodFilter(1, 2000, n));
+		       TEST_TRUE("non-null", streamed);
+		       TEST_TRUE("same foods as filter_food_vector", same_foods(*expected, *streamed));
+		     }
+		     auto everything = load_filtered_usda_abbrev("ABBREV.txt", FoodFilter(1, 2500, all_foods->size()));
+		     TEST_TRUE("same foods as filter_food_vector", same_foods(*filtered_foods, *everything));
+
+		     int visited = 0;
+		     TEST_TRUE("stream ok", stream_usda_abbrev("ABBREV.txt", [&](const std::shared_ptr<Food>&) {
+			   return ++visited < 5;
+			 }));
+		     TEST_EQUAL("stops when visit returns false", 5, visited);
+		     TEST_FALSE("missing file", load_filtered_usda_abbrev("no-such-file.txt", FoodFilter(1, 2000, 10)));
+		   });
+
   rubric.criterion("greedy_max_protein trivial cases", 2,
 		   [&]() {
 		     auto soln = greedy_max_protein(trivial_foods, 99);
@@ -84,6 +264,30 @@ int main() {
 		     TEST_EQUAL("2500 kcal solution", 595, protein2500);
 		   });
 
+  rubric.criterion("greedy matches the quadratic reference", 2,
+		   [&]() {
+		     FoodColumns columns(*filtered_foods);
+		     for (int budget : {0, 100, 1000, 2000, 2500, 100000}) {
+		       auto fast = greedy_selection(columns.kcal.data(), columns.protein_g.data(),
+						    columns.size(), budget);
+		       auto reference = greedy_selection_quadratic(columns.kcal.data(), columns.protein_g.data(),
+								   columns.size(), budget);
+		       TEST_TRUE("same foods and tie-breaks", fast == reference);
+		     }
+
+		     // Many ties in protein, to pin down the tie-break.
+		     std::vector<int32_t> kcal, protein_g;
+		     for (int i = 0; i < 200; i++) {
+		       kcal.push_back(1 + (i * 37) % 50);
+		       protein_g.push_back((i * 11) % 7);
+		     }
+		     for (int budget : {10, 100, 500, 1000}) {
+		       TEST_TRUE("same foods with ties",
+				 greedy_selection(kcal.data(), protein_g.data(), kcal.size(), budget) ==
+				 greedy_selection_quadratic(kcal.data(), protein_g.data(), kcal.size(), budget));
+		     }
+		   });
+  
   rubric.criterion("exhaustive_max_protein trivial cases", 2,
 		   [&]() {
 		     auto soln = exhaustive_max_protein(trivial_foods, 99);
@@ -129,5 +333,531 @@ int main() {
 		     }
 		   });
 
+  rubric.criterion("Gray-code exhaustive search", 2,
+		   [&]() {
+		     std::vector<int> optimal_protein_totals = {
+		       1, 1, 22, 45, 66, 85, 110, 113, 115, 118, 127, 135, 136,
+		       141, 149, 149, 151,
+		     };
+		     for (int n = 2; n <= 18; n++) {
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       auto reference = exhaustive_max_protein_selection(*small_foods, 2000);
+		       auto gray = exhaustive_max_protein_gray(FoodTable(*small_foods), 2000);
+		       TEST_EQUAL("optimal protein", optimal_protein_totals[n-2], gray.total_protein_g());
+		       TEST_TRUE("same subset", gray == reference);
+		       TEST_TRUE("same foods", same_foods(*exhaustive_max_protein(*small_foods, 2000),
+							  *exhaustive_max_protein_gray(*small_foods, 2000)));
+		     }
+		     for (int budget : {-1, 0, 99, 100, 150, 250}) {
+		       TEST_TRUE("trivial cases", exhaustive_max_protein_selection(trivial_foods, budget) ==
+				 exhaustive_max_protein_gray(FoodTable(trivial_foods), budget));
+		     }
+
+		     // Many ties and zero-protein foods, to pin down the tie-break.
+		     std::vector<int32_t> kcal, protein_g;
+		     for (int i = 0; i < 14; i++) {
+		       kcal.push_back(10 + (i * 7) % 30);
+		       protein_g.push_back((i % 3) * 2);
+		     }
+		     for (int budget : {5, 10, 35, 60, 200}) {
+		       TEST_TRUE("same subset with ties",
+				 exhaustive_selection_gray(kcal.data(), protein_g.data(), kcal.size(), budget) ==
+				 exhaustive_selection(kcal.data(), protein_g.data(), kcal.size(), budget));
+		     }
+		   });
+
+  rubric.criterion("parallel exhaustive search", 2,
+		   [&]() {
+		     for (int n : {0, 1, 2, 5, 12, 18}) {
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       FoodTable table(*small_foods);
+		       auto reference = exhaustive_max_protein(table, 2000);
+		       for (unsigned threads : {1, 2, 3, 7}) {
+			 TEST_TRUE("same subset for any thread count",
+				   exhaustive_max_protein_parallel(table, 2000, threads) == reference);
+		       }
+		       TEST_TRUE("same foods", same_foods(*exhaustive_max_protein(*small_foods, 2000),
+							  *exhaustive_max_protein_parallel(*small_foods, 2000)));
+		     }
+
+		     std::vector<int32_t> kcal, protein_g;
+		     for (int i = 0; i < 14; i++) {
+		       kcal.push_back(10 + (i * 7) % 30);
+		       protein_g.push_back((i % 3) * 2);
+		     }
+		     for (int budget : {5, 10, 35, 60, 200}) {
+		       for (unsigned threads : {1, 4}) {
+			 TEST_TRUE("same subset with ties",
+				   exhaustive_selection_parallel(kcal.data(), protein_g.data(), kcal.size(), budget, threads) ==
+				   exhaustive_selection(kcal.data(), protein_g.data(), kcal.size(), budget));
+		       }
+		     }
+		   });
+
+  rubric.criterion("vectorized exhaustive search", 2,
+		   [&]() {
+		     for (auto isa : {SimdIsa::scalar, SimdIsa::avx2, SimdIsa::avx512}) {
+		       if (!simd_isa_supported(isa)) {
+			 continue;
+		       }
+		       std::string name = simd_isa_name(isa);
+		       for (int n = 0; n <= 18; n++) {
+			 auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+			 FoodTable table(*small_foods);
+			 for (int budget : {-1, 0, 300, 2000}) {
+			   TEST_TRUE("same subset with " + name,
+				     exhaustive_max_protein_simd(table, budget, isa) ==
+				     exhaustive_max_protein(table, budget));
+			 }
+		       }
+
+		       std::vector<int32_t> kcal, protein_g;
+		       for (int i = 0; i < 14; i++) {
+			 kcal.push_back(10 + (i * 7) % 30);
+			 protein_g.push_back((i % 3) * 2);
+		       }
+		       for (int budget : {5, 10, 35, 60, 200}) {
+			 TEST_TRUE("same subset with ties with " + name,
+				   exhaustive_selection_simd(kcal.data(), protein_g.data(), kcal.size(), budget, isa) ==
+				   exhaustive_selection(kcal.data(), protein_g.data(), kcal.size(), budget));
+		       }
+		     }
+		   });
+
+  rubric.criterion("meet-in-the-middle search", 2,
+		   [&]() {
+		     std::vector<int> optimal_protein_totals = {
+		       1, 1, 22, 45, 66, 85, 110, 113, 115, 118, 127, 135, 136,
+		       141, 149, 149, 151,
+		     };
+		     for (int n = 2; n <= 18; n++) {
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       auto solution = meet_in_the_middle_max_protein(*small_foods, 2000);
+		       TEST_TRUE("non-null", solution);
+		       int kcal, protein;
+		       sum_food_vector(kcal, protein, *solution);
+		       TEST_LE("fits", kcal, 2000);
+		       TEST_EQUAL("optimal protein", optimal_protein_totals[n-2], protein);
+		     }
+		     for (int n : {0, 1, 7, 20, 24}) {
+		       FoodTable table(*filter_food_vector(*filtered_foods, 1, 2500, n));
+		       for (int budget : {-1, 0, 300, 1000, 2500}) {
+			 auto exact = exhaustive_max_protein_simd(table, budget);
+			 auto mitm = meet_in_the_middle_max_protein(table, budget);
+			 TEST_EQUAL("optimal protein", exact.total_protein_g(), mitm.total_protein_g());
+			 TEST_LE("fits", mitm.total_kcal(), std::max(budget, 0));
+			 int kcal, protein;
+			 sum_food_table(kcal, protein, table, mitm.indices());
+			 TEST_EQUAL("totals", kcal, mitm.total_kcal());
+			 TEST_EQUAL("totals", protein, mitm.total_protein_g());
+		       }
+		     }
+		     TEST_TRUE("empty solution", meet_in_the_middle_max_protein(trivial_foods, 99)->empty());
+
+		     // Memory is checked before the high half is stored.
+		     FoodTable table(*filter_food_vector(*filtered_foods, 1, 2500, 40));
+		     bool within_memory = false;
+		     auto roomy = meet_in_the_middle_max_protein(table, 2500, &within_memory);
+		     TEST_TRUE("within memory", within_memory);
+		     TEST_EQUAL("optimal protein", branch_and_bound_max_protein(table, 2500).total_protein_g(),
+				roomy.total_protein_g());
+		     const size_t tight = 1000 * sizeof(HalfSubset);
+		     TEST_TRUE("over memory", meet_in_the_middle_max_protein(table, 2500, &within_memory, tight).empty());
+		     TEST_FALSE("over memory", within_memory);
+		     TEST_TRUE("small budget fits", meet_in_the_middle_max_protein(table, 200, &within_memory, tight).size() > 0);
+		     TEST_TRUE("small budget fits", within_memory);
+		     auto foods = filter_food_vector(*filtered_foods, 1, 2500, 40);
+		     TEST_FALSE("over memory", meet_in_the_middle_max_protein(*foods, 2500, tight));
+		   });
+
+  rubric.criterion("branch and bound", 2,
+		   [&]() {
+		     for (int n : {0, 1, 7, 18, 24}) {
+		       FoodTable table(*filter_food_vector(*filtered_foods, 1, 2500, n));
+		       for (int budget : {-1, 0, 300, 1000, 2500}) {
+			 auto exact = exhaustive_max_protein_simd(table, budget);
+			 BranchAndBoundStats stats;
+			 auto bnb = branch_and_bound_max_protein(table, budget, BranchAndBoundLimits(), &stats);
+			 TEST_EQUAL("optimal protein", exact.total_protein_g(), bnb.total_protein_g());
+			 TEST_TRUE("proven optimal", stats.optimal);
+			 TEST_EQUAL("no gap", bnb.total_protein_g(), stats.upper_bound);
+			 int kcal, protein;
+			 sum_food_table(kcal, protein, table, bnb.indices());
+			 TEST_LE("fits", kcal, std::max(budget, 0));
+			 TEST_EQUAL("totals", kcal, bnb.total_kcal());
+			 TEST_EQUAL("totals", protein, bnb.total_protein_g());
+		       }
+		     }
+
+		     FoodTable table(*filter_food_vector(*filtered_foods, 1, 2500, 300));
+		     BranchAndBoundStats full, limited;
+		     auto optimal = branch_and_bound_max_protein(table, 2000, BranchAndBoundLimits(), &full);
+		     TEST_TRUE("proven optimal", full.optimal);
+		     TEST_GE("at least greedy", optimal.total_protein_g(),
+			     greedy_max_protein(table, 2000).total_protein_g());
+		     auto partial = branch_and_bound_max_protein(table, 2000, BranchAndBoundLimits(5), &limited);
+		     TEST_FALSE("stopped early", limited.optimal);
+		     TEST_EQUAL("node limit", 5, limited.nodes);
+		     TEST_LE("best so far", partial.total_protein_g(), optimal.total_protein_g());
+		     TEST_GE("valid upper bound", limited.upper_bound, optimal.total_protein_g());
+		     TEST_LE("fits", partial.total_kcal(), 2000);
+		   });
+
+  rubric.criterion("dynamic programming", 2,
+		   [&]() {
+		     std::vector<int> optimal_protein_totals = {
+		       1, 1, 22, 45, 66, 85, 110, 113, 115, 118, 127, 135, 136,
+		       141, 149, 149, 151,
+		     };
+		     for (int n = 2; n <= 18; n++) {
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       auto solution = dynamic_programming_max_protein(*small_foods, 2000);
+		       TEST_TRUE("non-null", solution);
+		       int kcal, protein;
+		       sum_food_vector(kcal, protein, *solution);
+		       TEST_LE("fits", kcal, 2000);
+		       TEST_EQUAL("optimal protein", optimal_protein_totals[n-2], protein);
+		     }
+		     for (int n : {0, 1, 7, 20}) {
+		       FoodTable table(*filter_food_vector(*filtered_foods, 1, 2500, n));
+		       for (int budget : {-1, 0, 300, 1000, 2500}) {
+			 auto exact = exhaustive_max_protein_simd(table, budget);
+			 auto dp = dynamic_programming_max_protein(table, budget);
+			 TEST_EQUAL("optimal protein", exact.total_protein_g(), dp.total_protein_g());
+			 int kcal, protein;
+			 sum_food_table(kcal, protein, table, dp.indices());
+			 TEST_EQUAL("totals", kcal, dp.total_kcal());
+			 TEST_EQUAL("totals", protein, dp.total_protein_g());
+		       }
+		     }
+		     TEST_TRUE("empty solution", dynamic_programming_max_protein(trivial_foods, 99)->empty());
+
+		     FoodTable table(*filtered_foods);
+		     for (int budget : {1000, 2000, 2500}) {
+		       auto dp = dynamic_programming_max_protein(table, budget);
+		       auto bnb = branch_and_bound_max_protein(table, budget);
+		       TEST_EQUAL("whole database", bnb.total_protein_g(), dp.total_protein_g());
+		       TEST_LE("fits", dp.total_kcal(), budget);
+		     }
+		   });
+
+  rubric.criterion("linear-memory dynamic programming", 2,
+		   [&]() {
+		     for (int n : {0, 1, 2, 7, 18, 300}) {
+		       FoodTable table(*filter_food_vector(*filtered_foods, 1, 2500, n));
+		       for (int budget : {-1, 0, 300, 1000, 2500}) {
+			 auto matrix = dynamic_programming_max_protein(table, budget);
+			 auto linear = dynamic_programming_linear_max_protein(table, budget);
+			 TEST_EQUAL("optimal protein", matrix.total_protein_g(), linear.total_protein_g());
+			 TEST_LE("fits", linear.total_kcal(), std::max(budget, 0));
+			 int kcal, protein;
+			 sum_food_table(kcal, protein, table, linear.indices());
+			 TEST_EQUAL("totals", kcal, linear.total_kcal());
+			 TEST_EQUAL("totals", protein, linear.total_protein_g());
+		       }
+		     }
+		     auto whole = dynamic_programming_linear_max_protein(*filtered_foods, 2500);
+		     int kcal, protein;
+		     sum_food_vector(kcal, protein, *whole);
+		     TEST_EQUAL("whole database", 614, protein);
+		   });
+
+  rubric.criterion("dual dynamic programming", 2,
+		   [&]() {
+		     for (int n : {0, 1, 2, 7, 18, 300}) {
+		       FoodTable table(*filter_food_vector(*filtered_foods, 1, 2500, n));
+		       for (int budget : {-1, 0, 300, 1000, 2500, 1000000}) {
+			 auto by_kcal = dynamic_programming_max_protein(table, std::min(budget, 100000));
+			 auto by_protein = dynamic_programming_by_protein_selection(table.kcal_data(), table.protein_g_data(),
+										   table.size(), budget);
+			 auto dual = dual_dynamic_programming_max_protein(table, budget);
+			 TEST_EQUAL("optimal protein", by_kcal.total_protein_g(), by_protein.total_protein_g());
+			 TEST_EQUAL("optimal protein", by_kcal.total_protein_g(), dual.total_protein_g());
+			 for (auto& selection : {by_protein, dual}) {
+			   int kcal, protein;
+			   sum_food_table(kcal, protein, table, selection.indices());
+			   if (budget < 0) {
+			     TEST_TRUE("nothing fits", selection.indices().empty());
+			   } else {
+			     TEST_LE("fits", kcal, budget);
+			   }
+			   TEST_EQUAL("totals", kcal, selection.total_kcal());
+			   TEST_EQUAL("totals", protein, selection.total_protein_g());
+			 }
+		       }
+		     }
+
+		     DpIndex index = DpIndex::protein;
+		     TEST_TRUE("negative budget", dual_dynamic_programming_max_protein(*filtered_foods, -1, &index)->empty());
+		     TEST_TRUE("negative budget reports kcal", index == DpIndex::kcal);
+		     dual_dynamic_programming_max_protein(*filtered_foods, 2000, &index);
+		     TEST_TRUE("small budget uses kcal", index == DpIndex::kcal);
+		     auto everything = dual_dynamic_programming_max_protein(*filtered_foods, 100000000, &index);
+		     TEST_TRUE("huge budget uses protein", index == DpIndex::protein);
+		     TEST_EQUAL("huge budget takes every food with protein",
+				std::count_if(filtered_foods->begin(), filtered_foods->end(),
+					      [](const std::shared_ptr<Food>& food) { return food->protein_g() > 0; }),
+				everything->size());
+		   });
+
+  rubric.criterion("protein frontier", 2,
+		   [&]() {
+		     FoodTable table(*filtered_foods);
+		     ProteinFrontier frontier(*filtered_foods, 2500);
+		     TEST_EQUAL("max_kcal", 2500, frontier.max_kcal());
+		     TEST_EQUAL("empty point", 0, frontier.point_kcal(0));
+		     TEST_EQUAL("empty point", 0, frontier.point_protein_g(0));
+		     bool increasing = true;
+		     for (size_t j = 1; j < frontier.size(); j++) {
+		       increasing = increasing && frontier.point_kcal(j) > frontier.point_kcal(j - 1)
+			 && frontier.point_protein_g(j) > frontier.point_protein_g(j - 1);
+		     }
+		     TEST_TRUE("strictly increasing", increasing);
+
+		     for (int budget : {-5, 0, 1, 17, 300, 1000, 2000, 2500}) {
+		       auto expected = dynamic_programming_max_protein(table, budget);
+		       auto selection = frontier.selection(budget);
+		       TEST_EQUAL("optimal protein", expected.total_protein_g(), frontier.max_protein_g(budget));
+		       int kcal, protein;
+		       sum_food_table(kcal, protein, table, selection.indices());
+		       TEST_LE("fits", kcal, std::max(budget, 0));
+		       TEST_EQUAL("totals", kcal, selection.total_kcal());
+		       TEST_EQUAL("totals", expected.total_protein_g(), protein);
+		     }
+		     TEST_TRUE("covers max_kcal", frontier.covers(2500));
+		     TEST_FALSE("does not cover over max_kcal", frontier.covers(2501));
+
+		     // When every food with protein fits at once, the table
+		     // stops at their kcal sum and every budget is answered.
+		     FoodTable small(*filter_food_vector(*filtered_foods, 1, 2500, 6));
+		     ProteinFrontier complete(small, 100000);
+		     int small_kcal, small_protein;
+		     sum_food_table(small_kcal, small_protein, small, complete.selection(std::numeric_limits<int>::max()).indices());
+		     TEST_EQUAL("complete", std::numeric_limits<int>::max(), complete.max_kcal());
+		     TEST_EQUAL("complete", small_protein, complete.max_protein_g(std::numeric_limits<int>::max()));
+		     TEST_EQUAL("complete", dynamic_programming_max_protein(small, 100000).total_protein_g(), small_protein);
+		     TEST_LE("table stops at kcal sum", complete.point_kcal(complete.size() - 1), small_kcal);
+
+		     // Foods over max_kcal could fit larger budgets, so those
+		     // are not covered even when the table is short.
+		     ProteinFrontier partial(small, 300);
+		     TEST_EQUAL("partial", 300, partial.max_kcal());
+		     TEST_EQUAL("partial", dynamic_programming_max_protein(small, 300).total_protein_g(), partial.max_protein_g(300));
+		     auto foods = frontier.max_protein(*filtered_foods, 2000);
+		     int kcal, protein;
+		     sum_food_vector(kcal, protein, *foods);
+		     TEST_EQUAL("FoodVector", frontier.max_protein_g(2000), protein);
+
+		     std::vector<int> answers(4, -1);
+		     std::vector<std::thread> threads;
+		     for (int t = 0; t < 4; t++) {
+		       threads.emplace_back([&, t]() { answers[t] = frontier.selection(1000 + 500 * t).total_protein_g(); });
+		     }
+		     for (auto& thread : threads) {
+		       thread.join();
+		     }
+		     bool shared = true;
+		     for (int t = 0; t < 4; t++) {
+		       shared = shared && answers[t] == frontier.max_protein_g(1000 + 500 * t);
+		     }
+		     TEST_TRUE("shared across threads", shared);
+		   });
+
+  rubric.criterion("dominance reduction", 2,
+		   [&]() {
+		     // Hand-built: 0 protein, over budget, and three copies of a
+		     // food of which only two fit.
+		     std::vector<int32_t> small_kcal = {100, 50, 900, 400, 400, 400, 450, 300},
+		       small_protein = {0, 10, 90, 40, 40, 40, 30, 35};
+		     auto reduction = reduce_foods(small_kcal.data(), small_protein.data(), small_kcal.size(), 800);
+		     TEST_TRUE("survivors", reduction.original == std::vector<int>({1, 3, 4, 7}));
+		     TEST_EQUAL("columns", 4, reduction.size());
+		     TEST_EQUAL("columns", 35, reduction.protein_g[3]);
+
+		     for (int n : {0, 5, 12, 20}) {
+		       FoodTable table(*filter_food_vector(*filtered_foods, 1, 2500, n));
+		       for (int budget : {-1, 0, 200, 1000, 2000}) {
+			 int expected = exhaustive_max_protein_gray(table, budget).total_protein_g();
+			 ReductionStats stats;
+			 auto exhaustive = exhaustive_max_protein_reduced(table, budget, &stats);
+			 auto mitm = meet_in_the_middle_max_protein_reduced(table, budget);
+			 auto bnb = branch_and_bound_max_protein_reduced(table, budget);
+			 TEST_EQUAL("original n", n, stats.original_n);
+			 TEST_LE("reduced n", stats.reduced_n, n);
+			 TEST_EQUAL("exhaustive", expected, exhaustive.total_protein_g());
+			 TEST_EQUAL("meet in the middle", expected, mitm.total_protein_g());
+			 TEST_EQUAL("branch and bound", expected, bnb.total_protein_g());
+			 int kcal, protein;
+			 sum_food_table(kcal, protein, table, exhaustive.indices());
+			 TEST_EQUAL("original indices", exhaustive.total_kcal(), kcal);
+			 TEST_EQUAL("original indices", expected, protein);
+		       }
+		     }
+
+		     ReductionStats stats;
+		     auto foods = branch_and_bound_max_protein_reduced(*filtered_foods, 2000, BranchAndBoundLimits(),
+								       nullptr, &stats);
+		     int kcal, protein;
+		     sum_food_vector(kcal, protein, *foods);
+		     TEST_EQUAL("whole database", dynamic_programming_max_protein(FoodTable(*filtered_foods), 2000).total_protein_g(),
+				protein);
+		     TEST_TRUE("whole database shrinks", stats.reduced_n < stats.original_n);
+		   });
+
+  rubric.criterion("FPTAS", 2,
+		   [&]() {
+		     FoodTable table(*filtered_foods);
+		     for (int budget : {-1, 0, 100, 1000, 2000}) {
+		       int optimal = dynamic_programming_max_protein(table, budget).total_protein_g();
+		       for (double epsilon : {0.01, 0.1, 0.5, 0.9}) {
+			 auto selection = fptas_max_protein(table, budget, epsilon);
+			 int kcal, protein;
+			 sum_food_table(kcal, protein, table, selection.indices());
+			 TEST_LE("fits", kcal, std::max(budget, 0));
+			 TEST_EQUAL("totals", kcal, selection.total_kcal());
+			 TEST_EQUAL("totals", protein, selection.total_protein_g());
+			 TEST_LE("no better than optimal", protein, optimal);
+			 TEST_LE("within 1 - epsilon", (1 - epsilon) * optimal, double(protein));
+		       }
+		     }
+
+		     // Large protein values force real scaling.
+		     std::vector<int32_t> kcal, protein;
+		     for (int i = 0; i < 40; i++) {
+		       kcal.push_back(50 + (i * 37) % 400);
+		       protein.push_back(100000 + (i * 7919) % 50000);
+		     }
+		     int optimal = dynamic_programming_selection(kcal.data(), protein.data(), 40, 2000).total_protein_g();
+		     double scale;
+		     auto coarse = fptas_selection(kcal.data(), protein.data(), 40, 2000, 0.2, &scale);
+		     TEST_TRUE("scaled", scale > 1);
+		     TEST_LE("within 1 - epsilon", 0.8 * optimal, double(coarse.total_protein_g()));
+		     auto fine = fptas_selection(kcal.data(), protein.data(), 40, 2000, 1e-6, &scale);
+		     TEST_EQUAL("tiny epsilon is exact", 1.0, scale);
+		     TEST_EQUAL("tiny epsilon is exact", optimal, fine.total_protein_g());
+		   });
+
+  rubric.criterion("allocation tracking", 2,
+		   [&]() {
+		     AllocationScope scope;
+		     std::vector<int> ints(1000);
+		     std::unique_ptr<Food> food(new Food("x", "1 cup", 100, 50, 5));
+		     AllocationStats stats = scope.stats();
+		     TEST_EQUAL("count", 2, stats.count);
+		     TEST_LE("bytes", 1000 * sizeof(int) + sizeof(Food), stats.bytes);
+		     TEST_LE("peak", int64_t(1000 * sizeof(int)), stats.peak_live_bytes);
+
+		     std::thread worker([]() { std::vector<int> more(10); });
+		     worker.join();
+		     TEST_LE("joined threads count", uint64_t(3), scope.stats().count);
+
+		     // The column searches must not allocate per subset.
+		     FoodTable table(*filter_food_vector(*filtered_foods, 1, 2500, 16));
+		     for (auto search : {exhaustive_selection, exhaustive_selection_gray}) {
+		       scope.reset();
+		       search(table.kcal_data(), table.protein_g_data(), table.size(), 2000);
+		       TEST_EQUAL("column exhaustive search does not allocate", 0, scope.stats().count);
+		     }
+		     scope.reset();
+		     exhaustive_selection_simd(table.kcal_data(), table.protein_g_data(), table.size(), 2000);
+		     TEST_EQUAL("simd exhaustive search does not allocate", 0, scope.stats().count);
+
+		     // Greedy shares the input's Food objects instead of copying,
+		     // so beyond the growth of its vectors, its allocations grow
+		     // with neither the input size nor the number of picks.
+		     auto greedy_allocations = [&](int n, int budget, size_t& picks) {
+		       auto foods = filter_food_vector(*filtered_foods, 1, 2500, n);
+		       scope.reset();
+		       picks = greedy_max_protein(*foods, budget)->size();
+		       return scope.stats().count;
+		     };
+		     size_t few_picks, more_input_picks, many_picks;
+		     uint64_t few = greedy_allocations(50, 2000, few_picks);
+		     uint64_t more_input = greedy_allocations(5000, 2000, more_input_picks);
+		     uint64_t many = greedy_allocations(500, 100000, many_picks);
+		     TEST_LE("greedy allocations do not grow with n", more_input, few + 2);
+		     TEST_LE("greedy picks many", few_picks * 50, many_picks);
+		     TEST_LE("greedy allocations do not grow with picks", many,
+			     few + uint64_t(std::ceil(std::log2(double(many_picks)))));
+		   });
+
+  rubric.criterion("FoodTable solvers", 2,
+		   [&]() {
+		     FoodTable table(*filtered_foods);
+		     TEST_EQUAL("size", filtered_foods->size(), table.size());
+		     TEST_TRUE("round trip", same_foods(*filtered_foods, *table.to_food_vector()));
+
+		     for (int budget : {2000, 2500}) {
+		       auto expected = greedy_max_protein(*filtered_foods, budget);
+		       auto selection = greedy_max_protein(table, budget);
+		       std::sort(expected->begin(), expected->end(),
+				 [&](const std::shared_ptr<Food>& a, const std::shared_ptr<Food>& b) {
+				   return std::find(filtered_foods->begin(), filtered_foods->end(), a) <
+				     std::find(filtered_foods->begin(), filtered_foods->end(), b);
+				 });
+		       TEST_TRUE("greedy picks the same foods",
+				 same_foods(*expected, *selection.to_food_vector(table)));
+		     }
+
+		     for (int n = 2; n <= 18; n++) {
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       FoodTable small_table(*small_foods);
+		       auto expected = exhaustive_max_protein(*small_foods, 2000);
+		       auto selection = exhaustive_max_protein(small_table, 2000);
+		       TEST_TRUE("exhaustive picks the same foods",
+				 same_foods(*expected, *selection.to_food_vector(small_table)));
+		       int expected_kcal, expected_protein, actual_kcal, actual_protein;
+		       sum_food_vector(expected_kcal, expected_protein, *expected);
+		       sum_food_table(actual_kcal, actual_protein, small_table, selection.indices());
+		       TEST_EQUAL("kcal", expected_kcal, actual_kcal);
+		       TEST_EQUAL("protein", expected_protein, actual_protein);
+		     }
+
+		     FoodTable trivial_table(trivial_foods);
+		     TEST_TRUE("empty solution", exhaustive_max_protein(trivial_table, 99).empty());
+		     TEST_TRUE("empty solution", greedy_max_protein(trivial_table, 99).empty());
+		   });
+
+  rubric.criterion("Selection", 2,
+		   [&]() {
+		     auto selection = greedy_max_protein_selection(*filtered_foods, 2000);
+		     TEST_EQUAL("precomputed protein", 476, selection.total_protein_g());
+		     TEST_FALSE("large indices are a list", selection.has_mask());
+		     int kcal, protein;
+		     sum_food_vector(kcal, protein, *selection.to_food_vector(*filtered_foods));
+		     TEST_EQUAL("precomputed kcal", kcal, selection.total_kcal());
+		     TEST_EQUAL("precomputed protein", protein, selection.total_protein_g());
+		     for (int i : selection.indices()) {
+		       TEST_TRUE("contains", selection.contains(i));
+		     }
+
+		     Selection round_trip;
+		     TEST_TRUE("deserialize", Selection::deserialize(selection.serialize(), round_trip));
+		     TEST_TRUE("round trip", selection == round_trip);
+		     TEST_FALSE("malformed", Selection::deserialize("12 x", round_trip));
+		     TEST_FALSE("malformed", Selection::deserialize("12 3 1,-2", round_trip));
+		     TEST_FALSE("index past int", Selection::deserialize("12 3 1,4294967297", round_trip));
+		     TEST_FALSE("index out of long range", Selection::deserialize("12 3 99999999999999999999", round_trip));
+		     TEST_TRUE("within input", Selection::deserialize(selection.serialize(), round_trip,
+								     filtered_foods->size()));
+		     TEST_FALSE("index past input", Selection::deserialize("12 3 1,10", round_trip, 10));
+		     TEST_TRUE("round trip unchanged by failures", selection == round_trip);
+
+		     auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, 10);
+		     auto mask = exhaustive_max_protein_selection(*small_foods, 2000);
+		     TEST_TRUE("small indices are a mask", mask.has_mask());
+		     TEST_EQUAL("optimal protein", 115, mask.total_protein_g());
+		     Selection listed(mask.indices(), mask.total_kcal(), mask.total_protein_g());
+		     TEST_TRUE("same selection from a list", mask == listed);
+		     TEST_TRUE("same selection from a list", listed.has_mask());
+		     TEST_TRUE("empty", Selection().empty());
+		     TEST_TRUE("empty round trip", Selection::deserialize(Selection().serialize(), round_trip));
+		     TEST_TRUE("empty round trip", round_trip.empty());
+
+		     auto shared = mask.to_food_vector(*small_foods);
+		     TEST_TRUE("foods are shared, not copied",
+			       std::find(small_foods->begin(), small_foods->end(), (*shared)[0]) != small_foods->end());
+		   });
+
   return rubric.run();
 }
@@ -1,1113 +1,797 @@
 ///////////////////////////////////////////////////////////////////////////////
 // maxprotein_timing.cc
 //
-// Example code showing how to run each algorithm while measuring
-// elapsed times precisely. You should modify this program to gather
-// all of your experimental data.
+// Benchmark runner for the max protein solvers. Sweeps every
+// combination of input size, calorie budget, solver and thread count,
+// runs each combination a number of warmup and timed repetitions, and
+// reports the min, median, 95th percentile, mean and standard
+// deviation of the elapsed times, as a table on stdout and optionally
+// as CSV and JSON files. With --counters, the mean hardware event
+// counts per run (cycles, instructions, cache and branch misses) are
+// reported too, where Linux perf_event_open allows. Built as
+// maxprotein_timing_alloc, with MAXPROTEIN_ALLOCATIONS defined,
+// --allocations reports the heap allocations per run, their bytes,
+// and the peak live bytes too, from alloc_tracker.hh; other builds
+// keep the standard operator new. Built as
+// maxprotein_timing_trace, with MAXPROTEIN_TRACE defined, --trace
+// writes the spans of the whole run (loading, filtering, every solver
+// run, and the parallel solvers' workers, one lane each) as Chrome
+// trace-event JSON.
+//
+// --fit fits each solver's median times against candidate complexity
+// models and reports the best. --baseline compares the medians with a
+// CSV file written by an earlier --csv run, and exits with status 1
+// when any solver got slower than --threshold allows, so the runner
+// can serve as a performance gate:
+//
+//    ./maxprotein_timing --csv baseline.csv          # known-good build
+//    ./maxprotein_timing --fit --baseline baseline.csv --threshold 0.1
+//
+// Run with --help for the options, e.g.
+//
+//    ./maxprotein_timing --n 10:24:2 --solver greedy,exhaustive --budget 1000,2000 --csv timing.csv
+//
+// Lists take comma-separated values, and numeric lists also accept
+// first:last:step ranges.
 //
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <cassert>
 #include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <string>
 #include <vector>
 
+#if defined(MAXPROTEIN_ALLOCATIONS)
+#include "alloc_tracker.hh"
+#endif
 #include "maxprotein.hh"
 #include "timer.hh"
 
 using namespace std;
 
-void print_bar() {
-    cout << string(79, '-') << endl;
+#if defined(MAXPROTEIN_ALLOCATIONS)
+
+// True when allocation tracking is compiled in.
+bool allocations_enabled() { return true; }
+
+#else
+
+bool allocations_enabled() { return false; }
+
+// Stand-ins for alloc_tracker.hh, which is left out so that the
+// runner's own allocations go through the standard operator new.
+// measure never creates a scope in this build.
+struct AllocationStats {
+    uint64_t count;
+    uint64_t bytes;
+    int64_t peak_live_bytes;
+    
+    AllocationStats() : count(0), bytes(0), peak_live_bytes(0) { }
+};
+
+class AllocationScope {
+public:
+    void reset() { }
+    AllocationStats stats() const { return AllocationStats(); }
+};
+
+#endif
+
+// A solver the runner can time. run returns the protein of the
+// solution found, which is reported so runs can be cross-checked.
+struct SolverSpec {
+    string name;
+    // Largest input the solver accepts.
+    int max_n;
+    // True for the O(2^n) searches, which are also limited by
+    // --max-exhaustive-n.
+    bool exhaustive;
+    // True when the solver takes a thread count, so it is run once per
+    // --threads value instead of once.
+    bool threaded;
+    function<int(const FoodVector&, int, unsigned)> run;
+};
+
+// Total protein of foods, or -1 when the solver gave no answer, as
+// meet_in_the_middle_max_protein does when it would run out of memory.
+int total_protein(const unique_ptr<FoodVector>& foods) {
+    if (!foods) {
+        return -1;
+    }
+    int kcal, protein;
+    sum_food_vector(kcal, protein, *foods);
+    return protein;
 }
 
-void print_star_line() {
-    cout << string(79, '*') << endl;
+vector<SolverSpec> all_solvers() {
+    return {
+        { "greedy", INT_MAX, false, false, [](const FoodVector& foods, int total_kcal, unsigned) {
+            return total_protein(greedy_max_protein(foods, total_kcal)); } },
+        { "exhaustive", 63, true, false, [](const FoodVector& foods, int total_kcal, unsigned) {
+            return total_protein(exhaustive_max_protein(foods, total_kcal)); } },
+        { "exhaustive_gray", 63, true, false, [](const FoodVector& foods, int total_kcal, unsigned) {
+            return total_protein(exhaustive_max_protein_gray(foods, total_kcal)); } },
+        { "exhaustive_parallel", 63, true, true, [](const FoodVector& foods, int total_kcal, unsigned threads) {
+            return total_protein(exhaustive_max_protein_parallel(foods, total_kcal, threads)); } },
+        { "exhaustive_simd", 63, true, false, [](const FoodVector& foods, int total_kcal, unsigned) {
+            return total_protein(exhaustive_max_protein_simd(foods, total_kcal)); } },
+        { "meet_in_the_middle", 63, false, false, [](const FoodVector& foods, int total_kcal, unsigned) {
+            return total_protein(meet_in_the_middle_max_protein(foods, total_kcal)); } },
+        { "branch_and_bound", INT_MAX, false, false, [](const FoodVector& foods, int total_kcal, unsigned) {
+            return total_protein(branch_and_bound_max_protein(foods, total_kcal)); } },
+        { "dynamic_programming", INT_MAX, false, false, [](const FoodVector& foods, int total_kcal, unsigned) {
+            return total_protein(dynamic_programming_max_protein(foods, total_kcal)); } },
+        { "dynamic_programming_linear", INT_MAX, false, false, [](const FoodVector& foods, int total_kcal, unsigned) {
+            return total_protein(dynamic_programming_linear_max_protein(foods, total_kcal)); } },
+        { "dual_dynamic_programming", INT_MAX, false, false, [](const FoodVector& foods, int total_kcal, unsigned) {
+            return total_protein(dual_dynamic_programming_max_protein(foods, total_kcal)); } },
+        { "fptas", INT_MAX, false, false, [](const FoodVector& foods, int total_kcal, unsigned) {
+            return total_protein(fptas_max_protein(foods, total_kcal, 0.1)); } },
+    };
 }
 
-int main() {
-    
-    const int n_test2 = 12;
-    const int n_test3 = 14;
-    const int n_test4 = 16;
-    const int n_test5 = 18;
-    const int n_test6 = 20;
-    const int n_test7 = 22;
-    const int n_test8 = 24;
-    const int n_test9 = 26;
-    const int n_test10 = 28;
-    const int n_test11 = 30;
-    const int n_test12_g = 32;
-    const int n_test13_g = 34;
-    const int n_test14_g = 36;
-    const int n_test15_g = 38;
-    const int n_test16_g = 40;
-    const int n_test17_g = 42;
-    const int n_test18_g = 44;
-    const int n_test19_g = 46;
-    const int n_test20_g = 48;
-    const int n_test21_g = 50;
-    const int n_test22_g = 52;
-    const int n_test23_g = 54;
-    const int n_test24_g = 56;
-    const int n_test25_g = 58;
-    const int n_test26_g = 60;
-    const int n_test27_g = 62;
-    
-    /*****************************************************
-     *** TEST VALUE 1:  n = 10 ***
-     ****************************************************/
-    print_star_line();
-    cout << "TEST 1: n = 10:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    const int n = 10,
-    total_kcal = 1000;
-    
-    auto all_foods = load_usda_abbrev("ABBREV.txt");
-    assert( all_foods );
-    
-    auto n_foods = filter_food_vector(*all_foods, 0, INT_MAX, n);
-    assert( n_foods );
-    assert( n_foods->size() == n );
-    
-    double elapsed;
+// Summary statistics of a set of timed repetitions, in seconds.
+struct SampleStats {
+    double min, median, p95, mean, stddev;
+};
+
+// The p95 is the nearest-rank percentile, and stddev is the sample
+// standard deviation (0 for a single sample).
+SampleStats summarize(vector<double> samples) {
+    assert(!samples.empty());
+    sort(samples.begin(), samples.end());
+    const size_t count = samples.size();
+    SampleStats stats;
+    stats.min = samples.front();
+    stats.median = (count % 2) ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+    stats.p95 = samples[size_t(ceil(0.95 * count)) - 1];
+    double sum = 0;
+    for (double s : samples) {
+        sum += s;
+    }
+    stats.mean = sum / count;
+    double squares = 0;
+    for (double s : samples) {
+        squares += (s - stats.mean) * (s - stats.mean);
+    }
+    stats.stddev = (count > 1) ? sqrt(squares / (count - 1)) : 0;
+    return stats;
+}
+
+// One row of results: a solver on one input size, budget and thread
+// count.
+struct Measurement {
+    string solver;
+    int n;
+    int total_kcal;
+    unsigned threads;
+    int repetitions;
+    // Protein of the solution found, or -1 when there was none.
+    int protein_g;
+    SampleStats seconds;
+    // Mean count per timed run of each PerfCounters event, or -1 when
+    // that counter was not measured.
+    double counts[PerfCounters::event_count];
+    // Mean allocations and bytes per timed run, and the largest peak
+    // live bytes of any run, when measured.
+    bool allocations_measured;
+    double allocations;
+    double allocated_bytes;
+    int64_t peak_live_bytes;
+};
+
+struct Options {
+    string data_path = "ABBREV.txt";
+    string snapshot_path = "ABBREV.snapshot";
+    vector<int> n_values;
+    vector<int> budgets = { 1000 };
+    vector<string> solvers = { "greedy", "exhaustive", "meet_in_the_middle" };
+    vector<int> thread_counts = { 1 };
+    int repetitions = 5;
+    int warmups = 1;
+    int max_exhaustive_n = 30;
+    bool counters = false;
+    bool allocations = false;
+    bool fit = false;
+    string baseline_path;
+    double threshold = 0.10;
+    double noise_floor = 1e-5;
+    string csv_path;
+    string json_path;
+    string trace_path;
+};
+
+void usage(ostream& out) {
+    out << "usage: maxprotein_timing [options]\n"
+        << "  --data PATH          ABBREV file to load (default ABBREV.txt)\n"
+        << "  --snapshot PATH      parsed-food cache for the data file (default ABBREV.snapshot)\n"
+        << "  --n LIST             input sizes; the first n foods are used (default 10:24:2)\n"
+        << "  --budget LIST        calorie budgets (default 1000)\n"
+        << "  --solver LIST        solvers to run, or 'all' (default greedy,exhaustive,meet_in_the_middle)\n"
+        << "  --threads LIST       thread counts for threaded solvers, 0 for one per core (default 1)\n"
+        << "  --repetitions N      timed runs per combination (default 5)\n"
+        << "  --warmup N           untimed runs before the timed ones (default 1)\n"
+        << "  --max-exhaustive-n N largest n for the O(2^n) exhaustive solvers (default 30)\n"
+        << "  --counters           also count cycles, instructions, cache and branch misses\n"
+        << "  --allocations        also count heap allocations, bytes and peak live bytes\n"
+        << "                       (needs a MAXPROTEIN_ALLOCATIONS build)\n"
+        << "  --fit                fit median times against complexity models per solver\n"
+        << "  --baseline PATH      compare medians with a CSV from an earlier --csv run,\n"
+        << "                       exiting with status 1 on any regression\n"
+        << "  --threshold X        relative slowdown counted as a regression (default 0.10)\n"
+        << "  --noise-floor S      ignore slowdowns of less than S seconds (default 1e-5)\n"
+        << "  --trace PATH         write Chrome trace-event JSON (needs a MAXPROTEIN_TRACE build)\n"
+        << "  --csv PATH           write results as CSV\n"
+        << "  --json PATH          write results as JSON\n"
+        << "solvers:";
+    for (auto& solver : all_solvers()) {
+        out << ' ' << solver.name;
+    }
+    out << '\n';
+}
+
+[[noreturn]] void fail(const string& message) {
+    cerr << "maxprotein_timing: " << message << '\n';
+    usage(cerr);
+    exit(2);
+}
+
+vector<string> split(const string& list) {
+    vector<string> result;
+    stringstream ss(list);
+    for (string item; getline(ss, item, ','); ) {
+        if (!item.empty()) {
+            result.push_back(item);
+        }
+    }
+    return result;
+}
+
+int parse_int(const string& text) {
+    char* end;
+    long value = strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || value < INT_MIN || value > INT_MAX) {
+        fail("not an integer: " + text);
+    }
+    return int(value);
+}
+
+double parse_double(const string& text) {
+    char* end;
+    double value = strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || !(value >= 0)) {
+        fail("not a non-negative number: " + text);
+    }
+    return value;
+}
+
+// Parse a list like "10,12,20:30:5" into 10, 12, 20, 25, 30.
+vector<int> parse_int_list(const string& list) {
+    vector<int> result;
+    for (auto& item : split(list)) {
+        vector<string> parts;
+        stringstream ss(item);
+        for (string part; getline(ss, part, ':'); ) {
+            parts.push_back(part);
+        }
+        if (parts.size() == 1) {
+            result.push_back(parse_int(parts[0]));
+        } else if (parts.size() == 2 || parts.size() == 3) {
+            int first = parse_int(parts[0]), last = parse_int(parts[1]);
+            int step = (parts.size() == 3) ? parse_int(parts[2]) : 1;
+            if (step <= 0) {
+                fail("range step must be positive: " + item);
+            }
+            for (int value = first; value <= last; value += step) {
+                result.push_back(value);
+            }
+        } else {
+            fail("bad range: " + item);
+        }
+    }
+    return result;
+}
+
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    options.n_values = parse_int_list("10:24:2");
+    for (int i = 1; i < argc; i++) {
+        string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            usage(cout);
+            exit(0);
+        }
+        if (flag == "--counters") {
+            options.counters = true;
+            continue;
+        }
+        if (flag == "--allocations") {
+            options.allocations = true;
+            continue;
+        }
+        if (flag == "--fit") {
+            options.fit = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fail("missing value for " + flag);
+        }
+        string value = argv[++i];
+        if (flag == "--data") {
+            options.data_path = value;
+        } else if (flag == "--snapshot") {
+            options.snapshot_path = value;
+        } else if (flag == "--n") {
+            options.n_values = parse_int_list(value);
+        } else if (flag == "--budget") {
+            options.budgets = parse_int_list(value);
+        } else if (flag == "--solver") {
+            options.solvers = split(value);
+        } else if (flag == "--threads") {
+            options.thread_counts = parse_int_list(value);
+        } else if (flag == "--repetitions") {
+            options.repetitions = parse_int(value);
+        } else if (flag == "--warmup") {
+            options.warmups = parse_int(value);
+        } else if (flag == "--max-exhaustive-n") {
+            options.max_exhaustive_n = parse_int(value);
+        } else if (flag == "--baseline") {
+            options.baseline_path = value;
+        } else if (flag == "--threshold") {
+            options.threshold = parse_double(value);
+        } else if (flag == "--noise-floor") {
+            options.noise_floor = parse_double(value);
+        } else if (flag == "--trace") {
+            options.trace_path = value;
+        } else if (flag == "--csv") {
+            options.csv_path = value;
+        } else if (flag == "--json") {
+            options.json_path = value;
+        } else {
+            fail("unknown option " + flag);
+        }
+    }
+    if (options.repetitions < 1 || options.warmups < 0) {
+        fail("need at least one repetition and no negative warmups");
+    }
+    for (int threads : options.thread_counts) {
+        if (threads < 0) {
+            fail("thread counts must not be negative");
+        }
+    }
+    return options;
+}
+
+// The solvers named in options, in the order given.
+vector<SolverSpec> selected_solvers(const Options& options) {
+    vector<SolverSpec> available = all_solvers(), result;
+    for (auto& name : options.solvers) {
+        if (name == "all") {
+            return available;
+        }
+        auto found = find_if(available.begin(), available.end(),
+                             [&](const SolverSpec& solver) { return solver.name == name; });
+        if (found == available.end()) {
+            fail("unknown solver " + name);
+        }
+        result.push_back(*found);
+    }
+    return result;
+}
+
+// Time solver, and when counters is not nullptr, count hardware events
+// around each timed run. Allocations are counted only when
+// options.allocations is set.
+Measurement measure(const SolverSpec& solver, const FoodVector& foods, int total_kcal,
+                    unsigned threads, const Options& options, PerfCounters* counters) {
+    Measurement result;
+    result.solver = solver.name;
+    result.n = foods.size();
+    result.total_kcal = total_kcal;
+    result.threads = threads;
+    result.repetitions = options.repetitions;
+    for (int i = 0; i < options.warmups; i++) {
+        result.protein_g = solver.run(foods, total_kcal, threads);
+    }
+    vector<double> samples;
+    double totals[PerfCounters::event_count] = { };
+    AllocationStats allocations;
+    unique_ptr<AllocationScope> scope;
+    if (options.allocations) {
+        scope.reset(new AllocationScope);
+    }
+    result.allocations_measured = options.allocations;
+    result.peak_live_bytes = 0;
     Timer timer;
-    
-    print_bar();
-    cout << "n = " << n << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer.reset();
-    auto greedy_solution = greedy_max_protein(*n_foods, total_kcal);
-    elapsed = timer.elapsed();
-    assert(greedy_solution);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution);
-    cout << endl;
-    cout << "elapsed time = " << elapsed << " seconds" << endl;
-    
-    print_bar();
-    if (n >= 64) {
-        cout << "(n too large, skipping exhaustive search)" << endl;
-    } else {
+    for (int i = 0; i < options.repetitions; i++) {
+        if (scope) {
+            scope->reset();
+        }
+        if (counters) {
+            counters->start();
+        }
         timer.reset();
-        auto exhaustive_solution = exhaustive_max_protein(*n_foods, total_kcal);
-        elapsed = timer.elapsed();
-        assert(exhaustive_solution);
-        cout << "exhaustive solution:" << endl;
-        print_food_vector(*exhaustive_solution);
-        cout << endl;
-        cout << "elapsed time = " << elapsed << " seconds" << endl;
+        result.protein_g = solver.run(foods, total_kcal, threads);
+        samples.push_back(timer.elapsed());
+        if (scope) {
+            AllocationStats run = scope->stats();
+            allocations.count += run.count;
+            allocations.bytes += run.bytes;
+            result.peak_live_bytes = max(result.peak_live_bytes, run.peak_live_bytes);
+        }
+        if (counters) {
+            counters->stop();
+            for (int e = 0; e < PerfCounters::event_count; e++) {
+                totals[e] += counters->count(PerfCounters::Event(e));
+            }
+        }
     }
-    print_bar();
-    
-    /*****************************************************
-     *** TEST VALUE 2:  n = 12 ***
-     ****************************************************/
-    
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 2: n = 12:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t2 = filter_food_vector(*all_foods, 0, INT_MAX, n_test2);
-    assert( n_foods_t2 );
-    assert( n_foods_t2->size() == n_test2 );
-    
-    double elapsed_t2;
-    Timer timer_t2;
-    
-    print_bar();
-    cout << "n_test2 = " << n_test2 << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t2.reset();
-    auto greedy_solution_t2 = greedy_max_protein(*n_foods_t2, total_kcal);
-    elapsed_t2 = timer_t2.elapsed();
-    assert(greedy_solution_t2);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t2);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t2 << " seconds" << endl;
-    
-    print_bar();
-    if (n_test2 >= 64) {
-        cout << "(n too large, skipping exhaustive search)" << endl;
-    } else {
-        timer_t2.reset();
-        auto exhaustive_solution_t2 = exhaustive_max_protein(*n_foods_t2, total_kcal);
-        elapsed_t2 = timer.elapsed();
-        assert(exhaustive_solution_t2);
-        cout << "exhaustive solution:" << endl;
-        print_food_vector(*exhaustive_solution_t2);
-        cout << endl;
-        cout << "elapsed time = " << elapsed_t2 << " seconds" << endl;
+    result.seconds = summarize(samples);
+    for (int e = 0; e < PerfCounters::event_count; e++) {
+        bool measured = counters && counters->available(PerfCounters::Event(e));
+        result.counts[e] = measured ? totals[e] / options.repetitions : -1;
     }
-    print_bar();
-    
-    /*****************************************************
-     *** TEST VALUE 3:  n = 14 ***
-     ****************************************************/
-    
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 3: n = 14:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t3 = filter_food_vector(*all_foods, 0, INT_MAX, n_test3);
-    assert( n_foods_t3 );
-    assert( n_foods_t3->size() == n_test3 );
-    
-    double elapsed_t3;
-    Timer timer_t3;
-    
-    print_bar();
-    cout << "n_test3 = " << n_test3 << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t3.reset();
-    auto greedy_solution_t3 = greedy_max_protein(*n_foods_t3, total_kcal);
-    elapsed_t3 = timer_t3.elapsed();
-    assert(greedy_solution_t3);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t3);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t3 << " seconds" << endl;
-    
-    print_bar();
-    if (n_test3 >= 64) {
-        cout << "(n too large, skipping exhaustive search)" << endl;
-    } else {
-        timer_t3.reset();
-        auto exhaustive_solution_t3 = exhaustive_max_protein(*n_foods_t3, total_kcal);
-        elapsed_t3 = timer.elapsed();
-        assert(exhaustive_solution_t3);
-        cout << "exhaustive solution:" << endl;
-        print_food_vector(*exhaustive_solution_t3);
-        cout << endl;
-        cout << "elapsed time = " << elapsed_t3 << " seconds" << endl;
+    result.allocations = double(allocations.count) / options.repetitions;
+    result.allocated_bytes = double(allocations.bytes) / options.repetitions;
+    return result;
+}
+
+void print_header(bool counters, bool allocations) {
+    cout << left << setw(28) << "solver" << right << setw(6) << "n" << setw(8) << "kcal"
+         << setw(8) << "threads" << setw(9) << "protein" << setw(13) << "min s" << setw(13) << "median s"
+         << setw(13) << "p95 s" << setw(13) << "stddev s";
+    if (counters) {
+        cout << setw(13) << "cycles" << setw(13) << "instr" << setw(7) << "IPC"
+             << setw(13) << "L1d miss" << setw(13) << "LLC miss" << setw(13) << "br miss";
     }
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 4:  n = 16 ***
-     ****************************************************/
-    
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 4: n = 16:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t4 = filter_food_vector(*all_foods, 0, INT_MAX, n_test4);
-    assert( n_foods_t4 );
-    assert( n_foods_t4->size() == n_test4 );
-    
-    double elapsed_t4;
-    Timer timer_t4;
-    
-    print_bar();
-    cout << "n_test4 = " << n_test4 << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t4.reset();
-    auto greedy_solution_t4 = greedy_max_protein(*n_foods_t4, total_kcal);
-    elapsed_t4 = timer_t4.elapsed();
-    assert(greedy_solution_t4);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t4);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t4 << " seconds" << endl;
-    
-    print_bar();
-    if (n_test4 >= 64) {
-        cout << "(n too large, skipping exhaustive search)" << endl;
-    } else {
-        timer_t4.reset();
-        auto exhaustive_solution_t4 = exhaustive_max_protein(*n_foods_t4, total_kcal);
-        elapsed_t4 = timer.elapsed();
-        assert(exhaustive_solution_t4);
-        cout << "exhaustive solution:" << endl;
-        print_food_vector(*exhaustive_solution_t4);
-        cout << endl;
-        cout << "elapsed time = " << elapsed_t4 << " seconds" << endl;
+    if (allocations) {
+        cout << setw(11) << "allocs" << setw(13) << "alloc B" << setw(13) << "peak B";
     }
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 5:  n = 18 ***
-     ****************************************************/
-    
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 5: n = 18:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t5 = filter_food_vector(*all_foods, 0, INT_MAX, n_test5);
-    assert( n_foods_t5 );
-    assert( n_foods_t5->size() == n_test5 );
-    
-    double elapsed_t5;
-    Timer timer_t5;
-    
-    print_bar();
-    cout << "n_test5 = " << n_test5 << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t5.reset();
-    auto greedy_solution_t5 = greedy_max_protein(*n_foods_t5, total_kcal);
-    elapsed_t5 = timer_t5.elapsed();
-    assert(greedy_solution_t5);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t5);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t5 << " seconds" << endl;
-    
-    print_bar();
-    if (n_test5 >= 64) {
-        cout << "(n too large, skipping exhaustive search)" << endl;
-    } else {
-        timer_t5.reset();
-        auto exhaustive_solution_t5 = exhaustive_max_protein(*n_foods_t5, total_kcal);
-        elapsed_t5 = timer.elapsed();
-        assert(exhaustive_solution_t5);
-        cout << "exhaustive solution:" << endl;
-        print_food_vector(*exhaustive_solution_t5);
-        cout << endl;
-        cout << "elapsed time = " << elapsed_t5 << " seconds" << endl;
+    cout << '\n';
+}
+
+// A mean count for the table, or n/a when it was not measured.
+string format_count(double count) {
+    if (count < 0) {
+        return "n/a";
     }
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 6:  n = 20 ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 6: n = 20:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t6 = filter_food_vector(*all_foods, 0, INT_MAX, n_test6);
-    assert( n_foods_t6 );
-    assert( n_foods_t6->size() == n_test6 );
-    
-    double elapsed_t6;
-    Timer timer_t6;
-    
-    print_bar();
-    cout << "n_test6 = " << n_test6 << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t6.reset();
-    auto greedy_solution_t6 = greedy_max_protein(*n_foods_t6, total_kcal);
-    elapsed_t6 = timer_t6.elapsed();
-    assert(greedy_solution_t6);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t6);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t6 << " seconds" << endl;
-    
-    print_bar();
-    if (n_test6 >= 64) {
-        cout << "(n too large, skipping exhaustive search)" << endl;
-    } else {
-        timer_t6.reset();
-        auto exhaustive_solution_t6 = exhaustive_max_protein(*n_foods_t6, total_kcal);
-        elapsed_t6 = timer.elapsed();
-        assert(exhaustive_solution_t6);
-        cout << "exhaustive solution:" << endl;
-        print_food_vector(*exhaustive_solution_t6);
-        cout << endl;
-        cout << "elapsed time = " << elapsed_t6 << " seconds" << endl;
+    stringstream ss;
+    ss << setprecision(4) << count;
+    return ss.str();
+}
+
+void print_row(const Measurement& m, bool counters) {
+    cout << left << setw(28) << m.solver << right << setw(6) << m.n << setw(8) << m.total_kcal
+         << setw(8) << m.threads << setw(9) << m.protein_g << setprecision(4)
+         << setw(13) << m.seconds.min << setw(13) << m.seconds.median
+         << setw(13) << m.seconds.p95 << setw(13) << m.seconds.stddev;
+    if (counters) {
+        double cycles = m.counts[PerfCounters::cycles], instructions = m.counts[PerfCounters::instructions];
+        cout << setw(13) << format_count(cycles) << setw(13) << format_count(instructions)
+             << setw(7) << ((cycles > 0 && instructions >= 0) ? format_count(instructions / cycles) : "n/a")
+             << setw(13) << format_count(m.counts[PerfCounters::l1d_misses])
+             << setw(13) << format_count(m.counts[PerfCounters::llc_misses])
+             << setw(13) << format_count(m.counts[PerfCounters::branch_misses]);
     }
-    print_bar();
-    /*****************************************************
-     *** TEST VALUE 7:  n = 22 ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 7: n = 22:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t7 = filter_food_vector(*all_foods, 0, INT_MAX, n_test7);
-    assert( n_foods_t7 );
-    assert( n_foods_t7->size() == n_test7 );
-    
-    double elapsed_t7;
-    Timer timer_t7;
-    
-    print_bar();
-    cout << "n_test7 = " << n_test7 << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t7.reset();
-    auto greedy_solution_t7 = greedy_max_protein(*n_foods_t7, total_kcal);
-    elapsed_t7 = timer_t7.elapsed();
-    assert(greedy_solution_t7);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t7);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t7 << " seconds" << endl;
-    
-    print_bar();
-    if (n_test7 >= 64) {
-        cout << "(n too large, skipping exhaustive search)" << endl;
-    } else {
-        timer_t7.reset();
-        auto exhaustive_solution_t7 = exhaustive_max_protein(*n_foods_t7, total_kcal);
-        elapsed_t7 = timer.elapsed();
-        assert(exhaustive_solution_t7);
-        cout << "exhaustive solution:" << endl;
-        print_food_vector(*exhaustive_solution_t7);
-        cout << endl;
-        cout << "elapsed time = " << elapsed_t7 << " seconds" << endl;
+    if (m.allocations_measured) {
+        cout << setw(11) << format_count(m.allocations) << setw(13) << format_count(m.allocated_bytes)
+             << setw(13) << m.peak_live_bytes;
     }
-    print_bar();
-    /*****************************************************
-     *** TEST VALUE 8:  n = 24 ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 8: n = 24:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t8 = filter_food_vector(*all_foods, 0, INT_MAX, n_test8);
-    assert( n_foods_t8 );
-    assert( n_foods_t8->size() == n_test8 );
-    
-    double elapsed_t8;
-    Timer timer_t8;
-    
-    print_bar();
-    cout << "n_test8 = " << n_test8 << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t8.reset();
-    auto greedy_solution_t8 = greedy_max_protein(*n_foods_t8, total_kcal);
-    elapsed_t8 = timer_t8.elapsed();
-    assert(greedy_solution_t8);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t8);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t8 << " seconds" << endl;
-    
-    print_bar();
-    if (n_test8 >= 64) {
-        cout << "(n too large, skipping exhaustive search)" << endl;
-    } else {
-        timer_t8.reset();
-        auto exhaustive_solution_t8 = exhaustive_max_protein(*n_foods_t8, total_kcal);
-        elapsed_t8 = timer.elapsed();
-        assert(exhaustive_solution_t8);
-        cout << "exhaustive solution:" << endl;
-        print_food_vector(*exhaustive_solution_t8);
-        cout << endl;
-        cout << "elapsed time = " << elapsed_t8 << " seconds" << endl;
+    cout << '\n' << flush;
+}
+
+void write_csv(const string& path, const vector<Measurement>& results) {
+    ofstream out(path);
+    out << "solver,n,total_kcal,threads,repetitions,protein_g,"
+        << "min_s,median_s,p95_s,mean_s,stddev_s";
+    for (int e = 0; e < PerfCounters::event_count; e++) {
+        out << ',' << PerfCounters::name(PerfCounters::Event(e));
     }
-    print_bar();
-    
-    /*****************************************************
-     *** TEST VALUE 9:  n = 26 ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 9: n = 26:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t9 = filter_food_vector(*all_foods, 0, INT_MAX, n_test9);
-    assert( n_foods_t9 );
-    assert( n_foods_t9->size() == n_test9 );
-    
-    double elapsed_t9;
-    Timer timer_t9;
-    
-    print_bar();
-    cout << "n_test9 = " << n_test9 << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t9.reset();
-    auto greedy_solution_t9 = greedy_max_protein(*n_foods_t9, total_kcal);
-    elapsed_t9 = timer_t9.elapsed();
-    assert(greedy_solution_t9);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t9);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t9 << " seconds" << endl;
-    
-    print_bar();
-    if (n_test9 >= 64) {
-        cout << "(n too large, skipping exhaustive search)" << endl;
-    } else {
-        timer_t9.reset();
-        auto exhaustive_solution_t9 = exhaustive_max_protein(*n_foods_t9, total_kcal);
-        elapsed_t9 = timer.elapsed();
-        assert(exhaustive_solution_t9);
-        cout << "exhaustive solution:" << endl;
-        print_food_vector(*exhaustive_solution_t9);
-        cout << endl;
-        cout << "elapsed time = " << elapsed_t9 << " seconds" << endl;
+    out << ",allocations,allocated_bytes,peak_live_bytes\n";
+    out << setprecision(9);
+    for (auto& m : results) {
+        out << m.solver << ',' << m.n << ',' << m.total_kcal << ',' << m.threads << ','
+            << m.repetitions << ',' << m.protein_g << ',' << m.seconds.min << ','
+            << m.seconds.median << ',' << m.seconds.p95 << ',' << m.seconds.mean << ','
+            << m.seconds.stddev;
+        // Counters that were not measured are left empty.
+        for (int e = 0; e < PerfCounters::event_count; e++) {
+            out << ',';
+            if (m.counts[e] >= 0) {
+                out << m.counts[e];
+            }
+        }
+        if (m.allocations_measured) {
+            out << ',' << m.allocations << ',' << m.allocated_bytes << ',' << m.peak_live_bytes;
+        } else {
+            out << ",,,";
+        }
+        out << '\n';
     }
-    print_bar();
-    
-    /*****************************************************
-     *** TEST VALUE 10:  n = 28 ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 10: n = 28:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t10 = filter_food_vector(*all_foods, 0, INT_MAX, n_test10);
-    assert( n_foods_t10 );
-    assert( n_foods_t10->size() == n_test10 );
-    
-    double elapsed_t10;
-    Timer timer_t10;
-    
-    print_bar();
-    cout << "n_test10 = " << n_test10 << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t10.reset();
-    auto greedy_solution_t10 = greedy_max_protein(*n_foods_t10, total_kcal);
-    elapsed_t10 = timer_t10.elapsed();
-    assert(greedy_solution_t10);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t10);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t10 << " seconds" << endl;
-    
-    print_bar();
-    if (n_test10 >= 64) {
-        cout << "(n too large, skipping exhaustive search)" << endl;
-    } else {
-        timer_t10.reset();
-        auto exhaustive_solution_t10 = exhaustive_max_protein(*n_foods_t10, total_kcal);
-        elapsed_t10 = timer.elapsed();
-        assert(exhaustive_solution_t10);
-        cout << "exhaustive solution:" << endl;
-        print_food_vector(*exhaustive_solution_t10);
-        cout << endl;
-        cout << "elapsed time = " << elapsed_t10 << " seconds" << endl;
+    if (!out) {
+        cerr << "maxprotein_timing: could not write " << path << '\n';
     }
-    print_bar();
-    
-    /*****************************************************
-     *** TEST VALUE 11:  n = 30 ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 11: n = 30:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t11 = filter_food_vector(*all_foods, 0, INT_MAX, n_test11);
-    assert( n_foods_t11 );
-    assert( n_foods_t11->size() == n_test11 );
-    
-    double elapsed_t11;
-    Timer timer_t11;
-    
-    print_bar();
-    cout << "n_test11 = " << n_test11 << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t11.reset();
-    auto greedy_solution_t11 = greedy_max_protein(*n_foods_t11, total_kcal);
-    elapsed_t11 = timer_t11.elapsed();
-    assert(greedy_solution_t11);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t11);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t11 << " seconds" << endl;
-    
-    print_bar();
-    if (n_test11 >= 64) {
-        cout << "(n too large, skipping exhaustive search)" << endl;
-    } else {
-        timer_t11.reset();
-        auto exhaustive_solution_t11 = exhaustive_max_protein(*n_foods_t11, total_kcal);
-        elapsed_t11 = timer.elapsed();
-        assert(exhaustive_solution_t11);
-        cout << "exhaustive solution:" << endl;
-        print_food_vector(*exhaustive_solution_t11);
-        cout << endl;
-        cout << "elapsed time = " << elapsed_t11 << " seconds" << endl;
+}
+
+void write_json(const string& path, const vector<Measurement>& results) {
+    ofstream out(path);
+    out << setprecision(9) << "[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& m = results[i];
+        out << "  {\"solver\": \"" << m.solver << "\", \"n\": " << m.n
+            << ", \"total_kcal\": " << m.total_kcal << ", \"threads\": " << m.threads
+            << ", \"repetitions\": " << m.repetitions << ", \"protein_g\": " << m.protein_g
+            << ", \"seconds\": {\"min\": " << m.seconds.min << ", \"median\": " << m.seconds.median
+            << ", \"p95\": " << m.seconds.p95 << ", \"mean\": " << m.seconds.mean
+            << ", \"stddev\": " << m.seconds.stddev << "}, \"counters\": {";
+        bool first = true;
+        for (int e = 0; e < PerfCounters::event_count; e++) {
+            if (m.counts[e] >= 0) {
+                out << (first ? "" : ", ") << '"' << PerfCounters::name(PerfCounters::Event(e))
+                    << "\": " << m.counts[e];
+                first = false;
+            }
+        }
+        out << '}';
+        if (m.allocations_measured) {
+            out << ", \"allocations\": {\"count\": " << m.allocations << ", \"bytes\": "
+                << m.allocated_bytes << ", \"peak_live_bytes\": " << m.peak_live_bytes << '}';
+        }
+        out << '}' << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    out << "]\n";
+    if (!out) {
+        cerr << "maxprotein_timing: could not write " << path << '\n';
+    }
+}
+
+// A candidate complexity model: the growth of running time with n
+// for a budget of total_kcal.
+struct ComplexityModel {
+    string name;
+    function<double(double n, double total_kcal)> growth;
+};
+
+vector<ComplexityModel> complexity_models() {
+    return {
+        { "n log n", [](double n, double) { return n * log2(max(n, 2.0)); } },
+        { "n^2", [](double n, double) { return n * n; } },
+        { "2^n n", [](double n, double) { return exp2(n) * n; } },
+        { "2^(n/2)", [](double n, double) { return exp2(n / 2); } },
+        { "n C", [](double n, double total_kcal) { return n * max(total_kcal, 1.0); } },
+    };
+}
+
+// The fit of one model to a series of measurements: median seconds is
+// about constant * growth(n, C). Times span orders of magnitude, so
+// the constant is fitted in log space, where it is the geometric mean
+// of seconds / growth, and the error is the root mean square of the
+// log residuals (0.1 is about 10% off).
+struct ComplexityFit {
+    string model;
+    double constant;
+    double rms_log_error;
+};
+
+ComplexityFit fit_model(const ComplexityModel& model, const vector<const Measurement*>& series) {
+    vector<double> residuals;
+    double sum = 0;
+    for (auto m : series) {
+        double r = log(max(m->seconds.median, 1e-12)) - log(model.growth(m->n, m->total_kcal));
+        residuals.push_back(r);
+        sum += r;
+    }
+    const double log_constant = sum / residuals.size();
+    double squares = 0;
+    for (double r : residuals) {
+        squares += (r - log_constant) * (r - log_constant);
+    }
+    return ComplexityFit{ model.name, exp(log_constant), sqrt(squares / residuals.size()) };
+}
+
+// Fit every model to each solver's measurements at each budget and
+// thread count with at least three values of n, and print the fits,
+// best first.
+void print_fits(const vector<Measurement>& results) {
+    vector<vector<const Measurement*>> groups;
+    for (auto& m : results) {
+        auto same = find_if(groups.begin(), groups.end(), [&](const vector<const Measurement*>& group) {
+            return group[0]->solver == m.solver && group[0]->total_kcal == m.total_kcal
+                && group[0]->threads == m.threads;
+        });
+        if (same == groups.end()) {
+            groups.push_back({ &m });
+        } else {
+            same->push_back(&m);
+        }
+    }
+
+    cout << "\ncomplexity fits (seconds ~ constant * model, by median time):\n";
+    for (auto& group : groups) {
+        const Measurement& first = *group[0];
+        cout << first.solver << ", total_kcal = " << first.total_kcal << ", threads = " << first.threads;
+        if (group.size() < 3) {
+            cout << ": too few sizes to fit\n";
+            continue;
+        }
+        vector<ComplexityFit> fits;
+        for (auto& model : complexity_models()) {
+            fits.push_back(fit_model(model, group));
+        }
+        sort(fits.begin(), fits.end(), [](const ComplexityFit& a, const ComplexityFit& b) {
+            return a.rms_log_error < b.rms_log_error;
+        });
+        cout << ": best " << fits[0].model << '\n';
+        for (auto& fit : fits) {
+            cout << "    " << left << setw(10) << fit.model << right << " constant = " << setprecision(4)
+                 << setw(11) << fit.constant << " s, rms log error = " << fit.rms_log_error << '\n';
+        }
+    }
+}
+
+// Compare results with the baseline CSV at path, matching rows by
+// solver, n, budget and thread count. A row regresses when its median
+// is more than threshold slower, relatively, and noise_floor slower,
+// absolutely, than the baseline's. Baseline rows that no result
+// matches are listed but do not fail the comparison. Returns the
+// number of regressions, or -1 when the baseline cannot be read or
+// no row of it matches a result, since then nothing was checked.
+int compare_baseline(const string& path, const vector<Measurement>& results,
+                     double threshold, double noise_floor) {
+    ifstream in(path);
+    string line;
+    if (!in || !getline(in, line)) {
+        cerr << "maxprotein_timing: could not read baseline " << path << '\n';
+        return -1;
+    }
+    vector<string> header;
+    stringstream header_stream(line);
+    for (string column; getline(header_stream, column, ','); ) {
+        header.push_back(column);
+    }
+    auto column_index = [&](const string& name) {
+        return int(find(header.begin(), header.end(), name) - header.begin());
+    };
+    const int solver_column = column_index("solver"), n_column = column_index("n"),
+        kcal_column = column_index("total_kcal"), threads_column = column_index("threads"),
+        median_column = column_index("median_s");
+    const int needed = max({ solver_column, n_column, kcal_column, threads_column, median_column });
+    if (needed >= int(header.size())) {
+        cerr << "maxprotein_timing: baseline " << path << " is not a maxprotein_timing CSV\n";
+        return -1;
+    }
+
+    int regressions = 0, compared = 0, unmatched = 0;
+    cout << "\nbaseline comparison with " << path << " (median, threshold "
+         << threshold * 100 << "%):\n";
+    while (getline(in, line)) {
+        vector<string> fields;
+        stringstream ss(line);
+        for (string field; getline(ss, field, ','); ) {
+            fields.push_back(field);
+        }
+        if (int(fields.size()) <= needed) {
+            continue;
+        }
+        bool matched = false;
+        for (auto& m : results) {
+            if (m.solver != fields[solver_column] || to_string(m.n) != fields[n_column]
+                || to_string(m.total_kcal) != fields[kcal_column]
+                || to_string(m.threads) != fields[threads_column]) {
+                continue;
+            }
+            matched = true;
+            compared++;
+            double before = strtod(fields[median_column].c_str(), nullptr), after = m.seconds.median;
+            bool regressed = (after > before * (1 + threshold)) && (after - before > noise_floor);
+            if (regressed) {
+                regressions++;
+            }
+            cout << (regressed ? "REGRESSION " : "ok         ") << left << setw(28) << m.solver << right
+                 << " n = " << setw(4) << m.n << ", total_kcal = " << setw(6) << m.total_kcal
+                 << ", threads = " << m.threads << ": " << setprecision(4) << before << " s -> "
+                 << after << " s (" << showpos << (before > 0 ? (after / before - 1) * 100 : 0)
+                 << noshowpos << "%)\n";
+        }
+        if (!matched) {
+            unmatched++;
+            cout << "not run    " << left << setw(28) << fields[solver_column] << right
+                 << " n = " << setw(4) << fields[n_column] << ", total_kcal = " << setw(6)
+                 << fields[kcal_column] << ", threads = " << fields[threads_column] << '\n';
+        }
+    }
+    cout << compared << " compared, " << regressions << " regressed, " << unmatched
+         << " baseline rows not run\n";
+    if (compared == 0) {
+        cerr << "maxprotein_timing: no results match baseline " << path << '\n';
+        return -1;
+    }
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parse_options(argc, argv);
+    vector<SolverSpec> solvers = selected_solvers(options);
+    if (!options.trace_path.empty() && !trace_enabled()) {
+        cerr << "maxprotein_timing: built without MAXPROTEIN_TRACE, so --trace records nothing; "
+             << "use maxprotein_timing_trace\n";
+    }
+    if (options.allocations && !allocations_enabled()) {
+        cerr << "maxprotein_timing: built without MAXPROTEIN_ALLOCATIONS, so --allocations is ignored; "
+             << "use maxprotein_timing_alloc\n";
+        options.allocations = false;
+    }
+    TRACE_THREAD_NAME("main");
+
+    auto all_foods = load_usda_abbrev_cached(options.data_path, options.snapshot_path);
+    if (!all_foods) {
+        cerr << "maxprotein_timing: could not load " << options.data_path << '\n';
+        return 1;
+    }
+
+    unique_ptr<PerfCounters> counters;
+    if (options.counters) {
+        counters.reset(new PerfCounters);
+        if (!counters->available()) {
+            cerr << "maxprotein_timing: hardware counters are unavailable here, "
+                 << "reporting wall time only\n";
+        }
+    }
+
+    // Each input is a prefix of the foods with kcal, which are fewer
+    // than all the foods.
+    auto usable_foods = filter_food_vector(*all_foods, 0, INT_MAX, all_foods->size());
+
+    vector<Measurement> results;
+    print_header(options.counters, options.allocations);
+    for (int n : options.n_values) {
+        if (n < 0 || size_t(n) > usable_foods->size()) {
+            cerr << "maxprotein_timing: skipping n = " << n << ", only "
+                 << usable_foods->size() << " foods with kcal\n";
+            continue;
+        }
+        FoodVector foods(usable_foods->begin(), usable_foods->begin() + n);
+        for (int total_kcal : options.budgets) {
+            for (auto& solver : solvers) {
+                if (n > solver.max_n || (solver.exhaustive && n > options.max_exhaustive_n)) {
+                    continue;
+                }
+                vector<int> thread_counts = solver.threaded ? options.thread_counts : vector<int>{ 1 };
+                for (int threads : thread_counts) {
+                    results.push_back(measure(solver, foods, total_kcal,
+                                              default_thread_count(threads), options, counters.get()));
+                    print_row(results.back(), options.counters);
+                }
+            }
+        }
+    }
+
+    if (!options.csv_path.empty()) {
+        write_csv(options.csv_path, results);
+    }
+    if (!options.json_path.empty()) {
+        write_json(options.json_path, results);
+    }
+    if (!options.trace_path.empty() && trace_enabled() && !write_chrome_trace(options.trace_path)) {
+        cerr << "maxprotein_timing: could not write " << options.trace_path << '\n';
+    }
+    if (options.fit) {
+        print_fits(results);
+    }
+    if (!options.baseline_path.empty()) {
+        int regressions = compare_baseline(options.baseline_path, results, options.threshold,
+                                           options.noise_floor);
+        if (regressions != 0) {
+            return 1;
+        }
     }
-    print_bar();
-    
-    /*****************************************************
-     *** TEST VALUE 12:  n = 32 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 12: n = 32:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t12 = filter_food_vector(*all_foods, 0, INT_MAX, n_test12_g);
-    assert( n_foods_t12 );
-    assert( n_foods_t12->size() == n_test12_g );
-    
-    double elapsed_t12;
-    Timer timer_t12;
-    
-    print_bar();
-    cout << "n_test12 = " << n_test12_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t12.reset();
-    auto greedy_solution_t12 = greedy_max_protein(*n_foods_t12, total_kcal);
-    elapsed_t12 = timer_t12.elapsed();
-    assert(greedy_solution_t12);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t12);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t12 << " seconds" << endl;
-    
-    print_bar();
-    
-    /*****************************************************
-     *** TEST VALUE 13:  n = 34 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 13: n = 34:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t13 = filter_food_vector(*all_foods, 0, INT_MAX, n_test13_g);
-    assert( n_foods_t13 );
-    assert( n_foods_t13->size() == n_test13_g );
-    
-    double elapsed_t13;
-    Timer timer_t13;
-    
-    print_bar();
-    cout << "n_test13 = " << n_test13_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t13.reset();
-    auto greedy_solution_t13 = greedy_max_protein(*n_foods_t13, total_kcal);
-    elapsed_t13 = timer_t13.elapsed();
-    assert(greedy_solution_t13);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t13);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t13 << " seconds" << endl;
-    
-    print_bar();
-    
-    /*****************************************************
-     *** TEST VALUE 14:  n = 36 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 14: n = 36:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t14 = filter_food_vector(*all_foods, 0, INT_MAX, n_test14_g);
-    assert( n_foods_t14 );
-    assert( n_foods_t14->size() == n_test14_g );
-    
-    double elapsed_t14;
-    Timer timer_t14;
-    
-    print_bar();
-    cout << "n_test14 = " << n_test14_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t14.reset();
-    auto greedy_solution_t14 = greedy_max_protein(*n_foods_t14, total_kcal);
-    elapsed_t14 = timer_t14.elapsed();
-    assert(greedy_solution_t14);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t14);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t14 << " seconds" << endl;
-    
-    print_bar();
-    
-    /*****************************************************
-     *** TEST VALUE 15:  n = 38 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 15: n = 38:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t15 = filter_food_vector(*all_foods, 0, INT_MAX, n_test15_g);
-    assert( n_foods_t15 );
-    assert( n_foods_t15->size() == n_test15_g );
-    
-    double elapsed_t15;
-    Timer timer_t15;
-    
-    print_bar();
-    cout << "n_test15 = " << n_test15_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t15.reset();
-    auto greedy_solution_t15 = greedy_max_protein(*n_foods_t15, total_kcal);
-    elapsed_t15 = timer_t15.elapsed();
-    assert(greedy_solution_t15);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t15);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t15 << " seconds" << endl;
-    
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 16:  n = 40 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 16: n = 40:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t16 = filter_food_vector(*all_foods, 0, INT_MAX, n_test16_g);
-    assert( n_foods_t16 );
-    assert( n_foods_t16->size() == n_test16_g );
-    
-    double elapsed_t16;
-    Timer timer_t16;
-    
-    print_bar();
-    cout << "n_test16 = " << n_test16_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t16.reset();
-    auto greedy_solution_t16 = greedy_max_protein(*n_foods_t16, total_kcal);
-    elapsed_t16 = timer_t16.elapsed();
-    assert(greedy_solution_t16);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t16);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t16 << " seconds" << endl;
-    
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 17:  n = 42 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 17: n = 42:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t17 = filter_food_vector(*all_foods, 0, INT_MAX, n_test17_g);
-    assert( n_foods_t17 );
-    assert( n_foods_t17->size() == n_test17_g );
-    
-    double elapsed_t17;
-    Timer timer_t17;
-    
-    print_bar();
-    cout << "n_test17 = " << n_test17_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t17.reset();
-    auto greedy_solution_t17 = greedy_max_protein(*n_foods_t17, total_kcal);
-    elapsed_t17 = timer_t17.elapsed();
-    assert(greedy_solution_t17);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t17);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t17 << " seconds" << endl;
-    
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 18:  n = 44 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 18: n = 44:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t18 = filter_food_vector(*all_foods, 0, INT_MAX, n_test18_g);
-    assert( n_foods_t18 );
-    assert( n_foods_t18->size() == n_test18_g );
-    
-    double elapsed_t18;
-    Timer timer_t18;
-    
-    print_bar();
-    cout << "n_test18 = " << n_test18_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t18.reset();
-    auto greedy_solution_t18 = greedy_max_protein(*n_foods_t18, total_kcal);
-    elapsed_t18 = timer_t18.elapsed();
-    assert(greedy_solution_t18);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t18);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t18 << " seconds" << endl;
-    
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 19:  n = 46 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 19: n = 46:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t19 = filter_food_vector(*all_foods, 0, INT_MAX, n_test19_g);
-    assert( n_foods_t19 );
-    assert( n_foods_t19->size() == n_test19_g );
-    
-    double elapsed_t19;
-    Timer timer_t19;
-    
-    print_bar();
-    cout << "n_test19 = " << n_test19_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t19.reset();
-    auto greedy_solution_t19 = greedy_max_protein(*n_foods_t19, total_kcal);
-    elapsed_t19 = timer_t19.elapsed();
-    assert(greedy_solution_t19);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t19);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t19 << " seconds" << endl;
-    
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 20:  n = 48 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 20: n = 48:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t20 = filter_food_vector(*all_foods, 0, INT_MAX, n_test20_g);
-    assert( n_foods_t20 );
-    assert( n_foods_t20->size() == n_test20_g );
-    
-    double elapsed_t20;
-    Timer timer_t20;
-    
-    print_bar();
-    cout << "n_test20 = " << n_test20_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t20.reset();
-    auto greedy_solution_t20 = greedy_max_protein(*n_foods_t20, total_kcal);
-    elapsed_t20 = timer_t20.elapsed();
-    assert(greedy_solution_t20);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t20);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t20 << " seconds" << endl;
-    
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 21:  n = 50 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 21: n = 50:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t21 = filter_food_vector(*all_foods, 0, INT_MAX, n_test21_g);
-    assert( n_foods_t21 );
-    assert( n_foods_t21->size() == n_test21_g );
-    
-    double elapsed_t21;
-    Timer timer_t21;
-    
-    print_bar();
-    cout << "n_test21 = " << n_test21_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t21.reset();
-    auto greedy_solution_t21 = greedy_max_protein(*n_foods_t21, total_kcal);
-    elapsed_t21 = timer_t21.elapsed();
-    assert(greedy_solution_t21);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t21);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t21 << " seconds" << endl;
-    
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 22:  n = 52 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 22: n = 52:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t22 = filter_food_vector(*all_foods, 0, INT_MAX, n_test22_g);
-    assert( n_foods_t22 );
-    assert( n_foods_t22->size() == n_test22_g );
-    
-    double elapsed_t22;
-    Timer timer_t22;
-    
-    print_bar();
-    cout << "n_test22 = " << n_test22_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t22.reset();
-    auto greedy_solution_t22 = greedy_max_protein(*n_foods_t22, total_kcal);
-    elapsed_t22 = timer_t22.elapsed();
-    assert(greedy_solution_t22);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t22);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t22 << " seconds" << endl;
-    
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 23:  n = 54 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 23: n = 54:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t23 = filter_food_vector(*all_foods, 0, INT_MAX, n_test23_g);
-    assert( n_foods_t23 );
-    assert( n_foods_t23->size() == n_test23_g );
-    
-    double elapsed_t23;
-    Timer timer_t23;
-    
-    print_bar();
-    cout << "n_test23 = " << n_test23_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t23.reset();
-    auto greedy_solution_t23 = greedy_max_protein(*n_foods_t23, total_kcal);
-    elapsed_t23 = timer_t23.elapsed();
-    assert(greedy_solution_t23);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t23);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t23 << " seconds" << endl;
-    
-    print_bar();
-    
-    /*****************************************************
-     *** TEST VALUE 24:  n = 56 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 24: n = 56:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t24 = filter_food_vector(*all_foods, 0, INT_MAX, n_test24_g);
-    assert( n_foods_t24 );
-    assert( n_foods_t24->size() == n_test24_g );
-    
-    double elapsed_t24;
-    Timer timer_t24;
-    
-    print_bar();
-    cout << "n_test24 = " << n_test24_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t24.reset();
-    auto greedy_solution_t24 = greedy_max_protein(*n_foods_t24, total_kcal);
-    elapsed_t24 = timer_t24.elapsed();
-    assert(greedy_solution_t24);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t24);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t24 << " seconds" << endl;
-    
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 25:  n = 58 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 25: n = 58:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t25 = filter_food_vector(*all_foods, 0, INT_MAX, n_test25_g);
-    assert( n_foods_t25 );
-    assert( n_foods_t25->size() == n_test25_g );
-    
-    double elapsed_t25;
-    Timer timer_t25;
-    
-    print_bar();
-    cout << "n_test25 = " << n_test25_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t25.reset();
-    auto greedy_solution_t25 = greedy_max_protein(*n_foods_t25, total_kcal);
-    elapsed_t25 = timer_t25.elapsed();
-    assert(greedy_solution_t25);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t25);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t25 << " seconds" << endl;
-    
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 26:  n = 60 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 26: n = 60:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t26 = filter_food_vector(*all_foods, 0, INT_MAX, n_test26_g);
-    assert( n_foods_t26 );
-    assert( n_foods_t26->size() == n_test26_g );
-    
-    double elapsed_t26;
-    Timer timer_t26;
-    
-    print_bar();
-    cout << "n_test26 = " << n_test26_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t26.reset();
-    auto greedy_solution_t26 = greedy_max_protein(*n_foods_t26, total_kcal);
-    elapsed_t26 = timer_t26.elapsed();
-    assert(greedy_solution_t26);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t26);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t26 << " seconds" << endl;
-    
-    print_bar();
-    
-    
-    /*****************************************************
-     *** TEST VALUE 27:  n = 62 GREEDY ONLY ***
-     ****************************************************/
-    cout << endl << endl;
-    print_star_line();
-    cout << "TEST 27: n = 62:" << endl;
-    print_star_line();
-    cout << endl;
-    
-    assert( all_foods );
-    
-    auto n_foods_t27 = filter_food_vector(*all_foods, 0, INT_MAX, n_test27_g);
-    assert( n_foods_t27 );
-    assert( n_foods_t27->size() == n_test27_g );
-    
-    double elapsed_t27;
-    Timer timer_t27;
-    
-    print_bar();
-    cout << "n_test27 = " << n_test27_g << ", total_kcal = " << total_kcal << endl;
-    
-    print_bar();
-    timer_t27.reset();
-    auto greedy_solution_t27 = greedy_max_protein(*n_foods_t27, total_kcal);
-    elapsed_t27 = timer_t27.elapsed();
-    assert(greedy_solution_t27);
-    cout << "greedy solution:" << endl;
-    print_food_vector(*greedy_solution_t27);
-    cout << endl;
-    cout << "elapsed time = " << elapsed_t27 << " seconds" << endl;
-    
-    print_bar();
-    
-    
-    
     return 0;
 }
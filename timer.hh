@@ -16,12 +16,35 @@
 //    double elapsed = timer.elapsed();
 //    cout << "Elapsed time in seconds: " << elapsed << endl;
 //
+// PerfCounters optionally adds hardware event counts (cycles,
+// instructions, cache and branch misses) read through Linux
+// perf_event_open. Where counters are unavailable, e.g. on other
+// platforms or in containers that forbid perf_event_open, it quietly
+// counts nothing, and callers fall back to wall time alone:
+//
+//    PerfCounters counters;
+//    counters.start();
+//    // run the code you want measured
+//    counters.stop();
+//    if (counters.available(PerfCounters::cycles)) {
+//      cout << counters.count(PerfCounters::cycles) << " cycles" << endl;
+//    }
+//
 ///////////////////////////////////////////////////////////////////////////////
 
 #pragma once
 
 #include <cassert>
 #include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 class Timer {
   /*
@@ -51,3 +74,137 @@ public:
  private:
   std::chrono::high_resolution_clock::time_point _start;
 };
+
+class PerfCounters {
+public:
+  enum Event {
+    cycles,
+    instructions,
+    l1d_misses,
+    llc_misses,
+    branch_misses,
+    event_count
+  };
+
+  // Open one counter per event for the calling thread and any threads
+  // it creates afterwards, user space only. Counters the kernel
+  // refuses are left unavailable.
+  PerfCounters() {
+    for (int e = 0; e < event_count; e++) {
+      _fd[e] = -1;
+      _count[e] = 0;
+#if defined(__linux__)
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.disabled = 1;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      switch (e) {
+      case cycles:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+      case instructions:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+      case l1d_misses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+      case llc_misses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+      case branch_misses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+      }
+      _fd[e] = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+  }
+
+  ~PerfCounters() {
+#if defined(__linux__)
+    for (int e = 0; e < event_count; e++) {
+      if (_fd[e] >= 0) {
+        close(_fd[e]);
+      }
+    }
+#endif
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  // True when at least one counter could be opened.
+  bool available() const {
+    for (int e = 0; e < event_count; e++) {
+      if (available(Event(e))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool available(Event event) const {
+    return _fd[event] >= 0;
+  }
+
+  // Zero and start every available counter.
+  void start() {
+#if defined(__linux__)
+    for (int e = 0; e < event_count; e++) {
+      if (_fd[e] >= 0) {
+        ioctl(_fd[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(_fd[e], PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+
+  // Stop every available counter and read the counts since start().
+  // Counts of counters the kernel multiplexed are scaled up to the
+  // whole interval.
+  void stop() {
+#if defined(__linux__)
+    for (int e = 0; e < event_count; e++) {
+      if (_fd[e] < 0) {
+        continue;
+      }
+      ioctl(_fd[e], PERF_EVENT_IOC_DISABLE, 0);
+      uint64_t values[3];
+      if (read(_fd[e], values, sizeof(values)) != ssize_t(sizeof(values))) {
+        _count[e] = 0;
+        continue;
+      }
+      const uint64_t value = values[0], enabled = values[1], running = values[2];
+      _count[e] = (running > 0 && running < enabled)
+        ? uint64_t(double(value) * enabled / running) : value;
+    }
+#endif
+  }
+
+  // The count of event between the last start() and stop(), or 0 if
+  // the counter is unavailable.
+  uint64_t count(Event event) const {
+    return _count[event];
+  }
+
+  static const char* name(Event event) {
+    static const char* names[event_count] = {
+      "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+    };
+    return names[event];
+  }
+
+ private:
+  int _fd[event_count];
+  uint64_t _count[event_count];
+};
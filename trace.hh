@@ -0,0 +1,210 @@
+///////////////////////////////////////////////////////////////////////////////
+// trace.hh
+//
+// Lightweight scoped trace spans, written as Chrome trace-event JSON
+// that opens in chrome://tracing or Perfetto. Tracing is compiled in
+// only when MAXPROTEIN_TRACE is defined; otherwise the macros below
+// expand to nothing and cost nothing.
+//
+// How to use:
+//
+//    void load() {
+//      TRACE_SPAN("load");
+//      // the span lasts until the end of the enclosing scope
+//    }
+//
+//    TRACE_THREAD_NAME("worker 1");   // label this thread's lane
+//    ...
+//    write_chrome_trace("trace.json");
+//
+// Each thread records into its own fixed-size ring buffer, so
+// recording takes no locks; when a ring is full the oldest spans are
+// overwritten. A thread's ring is handed on to the next new thread
+// when it exits, so programs that start and join workers repeatedly
+// use a bounded number of rings, one lane per concurrently running
+// thread. write_chrome_trace must be called when no other thread is
+// recording, e.g. after the workers have been joined.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <string>
+
+#if defined(MAXPROTEIN_TRACE)
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+
+namespace trace {
+
+// One finished span. name must outlive the trace, e.g. a literal.
+struct Event {
+  const char* name;
+  int64_t start_ns;
+  int64_t duration_ns;
+};
+
+const size_t ring_capacity = 1 << 14;
+
+// One lane of the trace: the ring of a running thread, or of a thread
+// that has exited, waiting to be reused.
+struct Ring {
+  Event events[ring_capacity];
+  // Number of events ever recorded; the newest is at
+  // (written - 1) % ring_capacity.
+  std::atomic<uint64_t> written;
+  std::atomic<bool> in_use;
+  int lane;
+  std::string name;
+  Ring* next;
+};
+
+// All rings ever created, newest first. Rings are never freed.
+inline std::atomic<Ring*>& rings() {
+  static std::atomic<Ring*> head(nullptr);
+  return head;
+}
+
+inline int64_t now_ns() {
+  static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - epoch).count();
+}
+
+// Claim a free ring, or create one and push it on rings(). A reclaimed
+// ring keeps the spans of the threads that had it before, which ran
+// earlier on the same lane, but not their name.
+inline Ring* claim_ring() {
+  for (Ring* ring = rings().load(std::memory_order_acquire); ring; ring = ring->next) {
+    bool expected = false;
+    if (ring->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+      ring->name = "thread " + std::to_string(ring->lane);
+      return ring;
+    }
+  }
+  static std::atomic<int> lanes(0);
+  Ring* ring = new Ring;
+  ring->written.store(0, std::memory_order_relaxed);
+  ring->in_use.store(true, std::memory_order_relaxed);
+  ring->lane = lanes++;
+  ring->name = "thread " + std::to_string(ring->lane);
+  Ring* head = rings().load(std::memory_order_relaxed);
+  do {
+    ring->next = head;
+  } while (!rings().compare_exchange_weak(head, ring, std::memory_order_release,
+                                          std::memory_order_relaxed));
+  return ring;
+}
+
+// The calling thread's ring, claimed on first use and released when
+// the thread exits.
+class ThreadRing {
+public:
+  ThreadRing() : _ring(claim_ring()) { }
+  ~ThreadRing() { _ring->in_use.store(false, std::memory_order_release); }
+  Ring& ring() { return *_ring; }
+
+private:
+  Ring* _ring;
+};
+
+inline Ring& thread_ring() {
+  static thread_local ThreadRing ring;
+  return ring.ring();
+}
+
+inline void record(const char* name, int64_t start_ns, int64_t duration_ns) {
+  Ring& ring = thread_ring();
+  uint64_t w = ring.written.load(std::memory_order_relaxed);
+  Event& event = ring.events[w % ring_capacity];
+  event.name = name;
+  event.start_ns = start_ns;
+  event.duration_ns = duration_ns;
+  ring.written.store(w + 1, std::memory_order_release);
+}
+
+inline void set_thread_name(const std::string& name) {
+  thread_ring().name = name;
+}
+
+// Records the time from its construction to its destruction.
+class Span {
+public:
+  explicit Span(const char* name) : _name(name), _start_ns(now_ns()) { }
+  ~Span() { record(_name, _start_ns, now_ns() - _start_ns); }
+
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+private:
+  const char* _name;
+  int64_t _start_ns;
+};
+
+// Write a JSON string literal holding text.
+inline void write_json_string(std::ostream& out, const std::string& text) {
+  out << '"';
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      out << ' ';
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+} // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name) trace::Span TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) trace::set_thread_name(name)
+
+// True when tracing is compiled in.
+inline bool trace_enabled() { return true; }
+
+// Write every recorded span, as Chrome trace-event JSON, to path, one
+// lane per ring. Returns false if the file cannot be written.
+inline bool write_chrome_trace(const std::string& path) {
+  std::ofstream out(path);
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  bool first = true;
+  for (trace::Ring* ring = trace::rings().load(std::memory_order_acquire); ring; ring = ring->next) {
+    out << (first ? "" : ",\n") << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": "
+        << ring->lane << ", \"args\": {\"name\": ";
+    trace::write_json_string(out, ring->name);
+    out << "}}";
+    first = false;
+    const uint64_t written = ring->written.load(std::memory_order_acquire);
+    const uint64_t oldest = (written > trace::ring_capacity) ? written - trace::ring_capacity : 0;
+    for (uint64_t i = oldest; i < written; i++) {
+      const trace::Event& event = ring->events[i % trace::ring_capacity];
+      out << ",\n{\"ph\": \"X\", \"name\": ";
+      trace::write_json_string(out, event.name);
+      out << ", \"pid\": 1, \"tid\": " << ring->lane << ", \"ts\": " << event.start_ns / 1000.0
+          << ", \"dur\": " << event.duration_ns / 1000.0 << "}";
+    }
+  }
+  out << "\n]}\n";
+  return bool(out);
+}
+
+#else
+
+#define TRACE_SPAN(name) do { } while (false)
+#define TRACE_THREAD_NAME(name) do { } while (false)
+
+inline bool trace_enabled() { return false; }
+
+// Tracing is compiled out, so there is nothing to write.
+inline bool write_chrome_trace(const std::string&) { return false; }
+
+#endif